@@ -0,0 +1,338 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "math/math.hpp"
+
+// Micro benchmarks of the math library : every case runs over arrays of count elements, small enough to stay in cache,
+// and reports the best time per operation out of a few runs. The scalar cases are plain loops over floats, the way the
+// library computed before its SIMD kernels, to compare against.
+
+static const size_t count = 1024;
+
+// Results are summed into this, so that the compiler can't drop the work
+static volatile float sink;
+
+template <typename Function>
+static void Run(const char* name, Function function)
+{
+	using Clock = std::chrono::steady_clock;
+	// Warm up, then enough calls to last about 20ms per run
+	function();
+	size_t calls = 1;
+	for (;;)
+	{
+		auto start = Clock::now();
+		for (size_t i = 0; i < calls; ++i)
+			function();
+		if (Clock::now() - start > std::chrono::milliseconds(20))
+			break;
+		calls *= 2;
+	}
+
+	double best = 1e30;
+	for (int run = 0; run < 5; ++run)
+	{
+		auto start = Clock::now();
+		for (size_t i = 0; i < calls; ++i)
+			function();
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		best = std::min(best, seconds / (double)(calls * count));
+	}
+
+	std::cout << std::left << std::setw(44) << name << std::right << std::fixed
+		<< std::setw(9) << std::setprecision(2) << best * 1e9 << " ns/op"
+		<< std::setw(10) << std::setprecision(1) << 1e-6 / best << " Mop/s" << std::endl;
+}
+
+static float Random()
+{
+	static uint32_t state = 12345;
+	state = state * 1664525u + 1013904223u;
+	return (float)(state >> 8) / (float)(1 << 24) * 2.0f - 1.0f;
+}
+
+int main()
+{
+	std::cout << "Math benchmark (" <<
+#if defined(MATH_SIMD_SSE)
+		"SSE"
+#elif defined(MATH_SIMD_NEON)
+		"NEON"
+#else
+		"no SIMD"
+#endif
+		<< ", " << count << " elements per call)" << std::endl << std::endl;
+
+	std::vector<Vec4> a(count), b(count), out(count);
+	std::vector<Vec3> normals(count);
+	std::vector<float> x(count), y(count), z(count), w(count);
+	std::vector<float> screen_x(count), screen_y(count), screen_z(count);
+	// Bounding spheres spread around the frustum
+	std::vector<float> sphere_x(count), sphere_y(count), sphere_z(count), sphere_radius(count, 0.5f);
+	std::vector<uint8_t> visible(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		a[i] = Vec4(Random(), Random(), Random(), 1.0f);
+		b[i] = Vec4(Random(), Random(), Random(), Random());
+		normals[i] = Vec3(Random(), Random(), Random() + 2.0f);
+		x[i] = a[i][0];
+		y[i] = a[i][1];
+		z[i] = a[i][2];
+		sphere_x[i] = x[i] * 10.0f;
+		sphere_y[i] = y[i] * 10.0f;
+		sphere_z[i] = z[i] * 10.0f;
+	}
+	std::vector<Mat4> matrices(count);
+	Mat4 m = Mat4::initPerspective(0.1f, 100.0f, 1.2f, 1.0f) * Mat4::initTranslation(Vec3(0.5f, -0.25f, -5.0f));
+	for (size_t i = 0; i < count; ++i)
+	{
+		matrices[i] = m;
+		matrices[i].data[3][0] = Random();
+	}
+
+	// ------------------------
+	// Vector operations
+	// ------------------------
+	Run("Vec4 add (scalar)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+			for (int c = 0; c < 4; ++c)
+				out[i].data[c] = a[i].data[c] + b[i].data[c];
+		sink = out[count - 1][0];
+	});
+	Run("Vec4 add (SIMD)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = a[i] + b[i];
+		sink = out[count - 1][0];
+	});
+	Run("Vec4 a + b - a / b (scalar)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+			for (int c = 0; c < 4; ++c)
+				out[i].data[c] = a[i].data[c] + b[i].data[c] - a[i].data[c] / b[i].data[c];
+		sink = out[count - 1][0];
+	});
+	Run("Vec4 a + b - a / b (SIMD expression)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = a[i] + b[i] - a[i] / b[i];
+		sink = out[count - 1][0];
+	});
+	Run("Vec4 dot (scalar)", [&]()
+	{
+		float sum = 0;
+		for (size_t i = 0; i < count; ++i)
+			sum += a[i].data[0] * b[i].data[0] + a[i].data[1] * b[i].data[1] + a[i].data[2] * b[i].data[2] + a[i].data[3] * b[i].data[3];
+		sink = sum;
+	});
+	Run("Vec4 dot (SIMD)", [&]()
+	{
+		float sum = 0;
+		for (size_t i = 0; i < count; ++i)
+			sum += a[i].dot(b[i]);
+		sink = sum;
+	});
+
+	// ------------------------
+	// Normalization
+	// ------------------------
+	Run("Vec3 normalize (sqrt and divisions)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			Vec3 n = normals[i];
+			float length = std::sqrt(n.data[0] * n.data[0] + n.data[1] * n.data[1] + n.data[2] * n.data[2]);
+			for (int c = 0; c < 3; ++c)
+				n.data[c] /= length;
+			sink = n[0];
+		}
+	});
+	Run("Vec3 normalize (Full)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			Vec3 n = normals[i];
+			n.normalize<fast::Accuracy::Full>();
+			sink = n[0];
+		}
+	});
+	Run("Vec3 normalize (Medium)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			Vec3 n = normals[i];
+			n.normalize<fast::Accuracy::Medium>();
+			sink = n[0];
+		}
+	});
+	Run("Vec3 normalize (Low)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			Vec3 n = normals[i];
+			n.normalize<fast::Accuracy::Low>();
+			sink = n[0];
+		}
+	});
+	Run("Vec4 normalize (SIMD, Full)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = b[i].getNormalized();
+		sink = out[count - 1][0];
+	});
+	Run("Vec4 normalize (SIMD, Medium)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = b[i].getNormalized<fast::Accuracy::Medium>();
+		sink = out[count - 1][0];
+	});
+
+	// ------------------------
+	// Matrix products
+	// ------------------------
+	Run("Mat4 * Vec4 (scalar)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+			for (int row = 0; row < 4; ++row)
+				out[i].data[row] = m.data[0][row] * a[i].data[0] + m.data[1][row] * a[i].data[1] + m.data[2][row] * a[i].data[2] + m.data[3][row] * a[i].data[3];
+		sink = out[count - 1][0];
+	});
+	Run("Mat4 * Vec4 (SIMD)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = m * a[i];
+		sink = out[count - 1][0];
+	});
+	Run("mul(Mat4, Vec4) (SIMD)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = mul(m, a[i]);
+		sink = out[count - 1][0];
+	});
+	Run("Mat4 * Mat4 (scalar)", [&]()
+	{
+		Mat4 result;
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (int column = 0; column < 4; ++column)
+				for (int row = 0; row < 4; ++row)
+				{
+					float dot = 0;
+					for (int k = 0; k < 4; ++k)
+						dot += m.data[k][row] * matrices[i].data[column][k];
+					result.data[column][row] = dot;
+				}
+			sink = result.data[3][0];
+		}
+	});
+	Run("Mat4 * Mat4 (SIMD)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			Mat4 result = m * matrices[i];
+			sink = result.data[3][0];
+		}
+	});
+	Run("mul(Mat4, Mat4) (SIMD)", [&]()
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			Mat4 result = mul(m, matrices[i]);
+			sink = result.data[3][0];
+		}
+	});
+	Run("Transform * Transform", [&]()
+	{
+		Transform parent = Transform::initRotation(Vec3(0.0f, 1.0f, 0.0f), 0.5f);
+		for (size_t i = 0; i < count; ++i)
+		{
+			Transform local(Quat(0.0f, 0.0f, 0.0f, 1.0f), Vec3(x[i], y[i], z[i]), 1.5f);
+			Transform world = parent * local;
+			sink = world.translation[0];
+		}
+	});
+
+	// ------------------------
+	// Batch transforms
+	// ------------------------
+	Run("Transform and project, per vertex", [&]()
+	{
+		float half = 400.0f;
+		for (size_t i = 0; i < count; ++i)
+		{
+			Vec4 clip = m * a[i];
+			float inv_w = 1.0f / clip[3];
+			out[i] = Vec4(clip[0] * (inv_w * half) + half, clip[1] * (inv_w * half) + half, clip[2] * inv_w, clip[3]);
+		}
+		sink = out[count - 1][0];
+	});
+	Run("batch::TransformProject", [&]()
+	{
+		batch::TransformProject(m, x.data(), y.data(), z.data(), count, 800.0f, 800.0f, screen_x.data(), screen_y.data(), screen_z.data(), w.data());
+		sink = screen_x[count - 1];
+	});
+	Run("batch::TransformPositions", [&]()
+	{
+		batch::TransformPositions(m, x.data(), y.data(), z.data(), count, screen_x.data(), screen_y.data(), screen_z.data(), w.data());
+		sink = screen_x[count - 1];
+	});
+
+	// ------------------------
+	// Fast math
+	// ------------------------
+	Run("sin and cos (<cmath>)", [&]()
+	{
+		float sum = 0;
+		for (size_t i = 0; i < count; ++i)
+			sum += std::sin(x[i] * 10.0f) + std::cos(x[i] * 10.0f);
+		sink = sum;
+	});
+	Run("fast::sincos (Medium)", [&]()
+	{
+		float sum = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			float s, c;
+			fast::sincos(x[i] * 10.0f, s, c);
+			sum += s + c;
+		}
+		sink = sum;
+	});
+	Run("fast::sincos, 4 wide (Medium)", [&]()
+	{
+		simd::float4 sum = simd::splat(0.0f);
+		for (size_t i = 0; i < count; i += 4)
+		{
+			simd::float4 s, c;
+			fast::sincos(simd::mul(simd::load(&x[i]), simd::splat(10.0f)), s, c);
+			sum = simd::add(sum, simd::add(s, c));
+		}
+		float lanes[4];
+		simd::store(lanes, sum);
+		sink = lanes[0];
+	});
+
+	// ------------------------
+	// Culling
+	// ------------------------
+	Frustum frustum(m);
+	Run("Frustum sphere test, one by one", [&]()
+	{
+		size_t num_visible = 0;
+		for (size_t i = 0; i < count; ++i)
+			num_visible += frustum.intersects(Sphere(Vec3(sphere_x[i], sphere_y[i], sphere_z[i]), sphere_radius[i]));
+		sink = (float)num_visible;
+	});
+	Run("Frustum::cullSpheres", [&]()
+	{
+		sink = (float)frustum.cullSpheres(sphere_x.data(), sphere_y.data(), sphere_z.data(), sphere_radius.data(), count, visible.data());
+	});
+
+	return 0;
+}
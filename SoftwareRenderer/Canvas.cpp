@@ -1,22 +1,52 @@
 
 #include "Canvas.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <string>
 #include <iostream>
 #include <vector>
 #include <limits>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-
 namespace Canvas {
 
+// The canvas lives here only, everything else goes through the functions below
+static unsigned int size_x;
+static unsigned int size_y;
+
+static GLuint program;
+static GLuint texture;
+
+static unsigned char screen[800][800][3];
+static float         depth_buffer[800][800];
+
+// Weighted blended OIT targets
+static float accumulation[800][800][4];
+static float revealage[800][800];
+static bool  has_transparency = false;
+
+static void ClearTransparency()
+{
+	for (unsigned int y = 0; y < size_y; ++y)
+	{
+		for (unsigned int x = 0; x < size_x; ++x)
+		{
+			accumulation[y][x][0] = accumulation[y][x][1] = accumulation[y][x][2] = accumulation[y][x][3] = 0;
+			revealage[y][x] = 1;
+		}
+	}
+	has_transparency = false;
+}
+
 void Init(unsigned int sizex, unsigned int sizey)
 {
 	size_x = sizex;
 	size_y = sizey;
 
+	ClearTransparency();
+
 	// Init glew
 	if (glewInit() != GLEW_OK)
 	{
@@ -134,13 +164,6 @@ void Init(unsigned int sizex, unsigned int sizey)
 		GetError(false, program);
 	}
 
-	int width, height, bpp;
-	unsigned char* raw_data = stbi_load("test.png", &width, &height, &bpp, STBI_rgb);
-	if (raw_data == nullptr) {
-		std::cerr << "Error: Could not load PNG image in LoadTexturePNG : " << "test.png" << std::endl;
-		return;
-	}
-
 	// Create 800x600 texture to render onto the screen
 	glGenTextures(1, &texture);
 	glBindTexture(GL_TEXTURE_2D, texture);
@@ -154,8 +177,6 @@ void Init(unsigned int sizex, unsigned int sizey)
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	stbi_image_free(raw_data);
-
 	// Initialize depth buffer to be all INF
 	float float_inf = std::numeric_limits<float>::infinity();
 	for (int i = 0; i < 800; ++i)
@@ -167,18 +188,38 @@ void Init(unsigned int sizex, unsigned int sizey)
 	}
 }
 
+unsigned int GetWidth()
+{
+	return size_x;
+}
+
+unsigned int GetHeight()
+{
+	return size_y;
+}
+
 void Clear(Color color)
 {
-	for (int i = 0; i < 800; ++i)
+	for (unsigned int y = 0; y < size_y; ++y)
 	{
-		for (int j = 0; j < 600; ++j)
+		for (unsigned int x = 0; x < size_x; ++x)
 		{
-			screen[i][j][0] = 255;
-			screen[i][j][1] = 0;
-			screen[i][j][2] = 255;
-			screen[i][j][3] = 255;
+			memcpy((void*)screen[y][x], &color, 3);
 		}
 	}
+
+	// Reset the depth buffer to be all INF as well
+	float float_inf = std::numeric_limits<float>::infinity();
+	for (unsigned int x = 0; x < size_x; ++x)
+	{
+		for (unsigned int y = 0; y < size_y; ++y)
+		{
+			depth_buffer[x][y] = float_inf;
+		}
+	}
+
+	if (has_transparency)
+		ClearTransparency();
 }
 
 void Draw(unsigned int x, unsigned int y, Color color)
@@ -186,6 +227,11 @@ void Draw(unsigned int x, unsigned int y, Color color)
 	memcpy((void*)screen[y][x], &color, 3);
 }
 
+bool DepthTest(unsigned int x, unsigned int y, float z)
+{
+	return depth_buffer[x][y] >= z;
+}
+
 bool DrawIfNearer(unsigned int x, unsigned y, float z)
 {
 	// First, check the depth buffer to see current depth
@@ -201,8 +247,78 @@ void DrawDepth(unsigned int x, unsigned int y, float z)
 	depth_buffer[x][y] = z;
 }
 
+void BlendAlpha(unsigned int x, unsigned int y, float r, float g, float b, float a)
+{
+	unsigned char* pixel = screen[y][x];
+	pixel[0] = (unsigned char)(r * a + pixel[0] * (1 - a));
+	pixel[1] = (unsigned char)(g * a + pixel[1] * (1 - a));
+	pixel[2] = (unsigned char)(b * a + pixel[2] * (1 - a));
+}
+
+void BlendAdditive(unsigned int x, unsigned int y, float r, float g, float b, float a)
+{
+	unsigned char* pixel = screen[y][x];
+	pixel[0] = (unsigned char)std::min(pixel[0] + r * a, 255.0f);
+	pixel[1] = (unsigned char)std::min(pixel[1] + g * a, 255.0f);
+	pixel[2] = (unsigned char)std::min(pixel[2] + b * a, 255.0f);
+}
+
+void BlendMultiply(unsigned int x, unsigned int y, float r, float g, float b)
+{
+	unsigned char* pixel = screen[y][x];
+	pixel[0] = (unsigned char)(pixel[0] * r * (1.0f / 255.0f));
+	pixel[1] = (unsigned char)(pixel[1] * g * (1.0f / 255.0f));
+	pixel[2] = (unsigned char)(pixel[2] * b * (1.0f / 255.0f));
+}
+
+void Accumulate(unsigned int x, unsigned int y, float r, float g, float b, float a, float z)
+{
+	// Depth weight from McGuire and Bavoil, nearer fragments count more (z is in [-1,1])
+	float d = 1.0f - (z * 0.5f + 0.5f);
+	float weight = a * std::max(1e-2f, 3e3f * d * d * d);
+
+	// Premultiplied color
+	float* accum = accumulation[y][x];
+	accum[0] += r * a * weight;
+	accum[1] += g * a * weight;
+	accum[2] += b * a * weight;
+	accum[3] += a * weight;
+	revealage[y][x] *= 1 - a;
+	has_transparency = true;
+}
+
+void Resolve()
+{
+	if (!has_transparency)
+		return;
+
+	// Composite the average transparent color over the opaque pixels
+	for (unsigned int y = 0; y < size_y; ++y)
+	{
+		for (unsigned int x = 0; x < size_x; ++x)
+		{
+			float reveal = revealage[y][x];
+			if (reveal == 1)
+				continue;
+
+			const float* accum = accumulation[y][x];
+			float inv_weight = 1.0f / std::min(std::max(accum[3], 1e-4f), 5e4f);
+			unsigned char* pixel = screen[y][x];
+			for (int c = 0; c < 3; ++c)
+			{
+				float color = std::min(accum[c] * inv_weight, 255.0f);
+				pixel[c] = (unsigned char)(color * (1 - reveal) + pixel[c] * reveal);
+			}
+		}
+	}
+
+	ClearTransparency();
+}
+
 void Update()
 {
+	Resolve();
+
 	glBindTexture(GL_TEXTURE_2D, texture);
 	glTexImage2D(GL_TEXTURE_2D, 0, 3, size_x, size_y, 0, GL_RGB, GL_UNSIGNED_BYTE, (GLvoid*)screen);
 }
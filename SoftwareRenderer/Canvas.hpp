@@ -7,23 +7,35 @@
 
 typedef int Color; // RGB
 
-namespace Canvas {
-
-	static unsigned int size_x;
-	static unsigned int size_y;
+// How a fragment is combined with what is already on the canvas
+enum class BlendMode : unsigned short
+{
+	None,		// Overwrite
+	Alpha,		// src * a + dst * (1 - a)
+	Additive,	// dst + src * a
+	Multiply,	// dst * src
+	WeightedOIT,// Order independent transparency, accumulated then composited at resolve
+	Count
+};
 
-	static GLuint program;
-	static GLuint texture;
-
-	static unsigned char screen[800][800][3];
-	static float         depth_buffer[800][800];
+namespace Canvas {
 
 	void Init(unsigned int sizex, unsigned int sizey);
+	unsigned int GetWidth();
+	unsigned int GetHeight();
 	void Clear(Color color);
 	void Draw(unsigned int x, unsigned int y, Color color);
 	void DrawDepth(unsigned int x, unsigned int y, float z);
+	bool DepthTest(unsigned int x, unsigned int y, float z);
 	bool DrawIfNearer(unsigned int x, unsigned y, float z);
-	void Update();
+	// Blending, source colors are in [0,255] and alpha in [0,1]
+	void BlendAlpha(unsigned int x, unsigned int y, float r, float g, float b, float a);
+	void BlendAdditive(unsigned int x, unsigned int y, float r, float g, float b, float a);
+	void BlendMultiply(unsigned int x, unsigned int y, float r, float g, float b);
+	// Weighted blended order independent transparency : accumulate now, composite in Resolve
+	void Accumulate(unsigned int x, unsigned int y, float r, float g, float b, float a, float z);
+	void Resolve();
+	void Update(); // Resolves first if needed
 	void Render();
 }
 
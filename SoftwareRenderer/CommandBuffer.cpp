@@ -0,0 +1,238 @@
+#include "CommandBuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace CommandBuffer {
+
+struct ClearCommand
+{
+	CommandHeader header;
+	Color color;
+};
+
+struct DrawCommand
+{
+	CommandHeader header;
+	RenderPass::VertexShader vertex_shader;
+	RenderPass::FragmentShader fragment_shader;
+	const UniformBlock* uniforms;
+	RenderPass::PipelineState pipeline_state;
+	const void* vertex_buffer;
+	const void* instance_buffer;
+	const void* indices; // nullptr for non indexed draws
+	uint32_t num_elements; // vertices or indices
+	RenderPass::IndexType index_type;
+	uint16_t num_instances;
+	uint16_t num_attributes;
+	uint16_t stride;
+	uint16_t instance_stride;
+	// Followed by num_attributes VertexAttribute
+};
+
+// Commands are padded so that the next one is always aligned
+static const uint32_t command_alignment = alignof(DrawCommand);
+
+static void* Allocate(Buffer& buffer, CommandType type, uint32_t size)
+{
+	size = (size + command_alignment - 1) & ~(command_alignment - 1);
+	assert(size <= 0xFFFF);
+
+	uint32_t offset = (uint32_t)buffer.memory.size();
+	buffer.memory.resize(offset + size);
+	buffer.offsets.push_back(offset);
+
+	CommandHeader* header = (CommandHeader*)&buffer.memory[offset];
+	header->type = type;
+	header->size = (uint16_t)size;
+	header->sort_key = buffer.sort_key;
+	return header;
+}
+
+void Reset(Buffer& buffer)
+{
+	buffer.memory.clear();
+	buffer.offsets.clear();
+	buffer.sort_key = 0;
+	buffer.vertex_shader = nullptr;
+	buffer.fragment_shader = nullptr;
+	buffer.uniforms = nullptr;
+	buffer.pipeline_state = RenderPass::CreatePipelineState(RenderPass::PipelineStateDesc());
+}
+
+void SetSortKey(Buffer& buffer, uint32_t key)
+{
+	buffer.sort_key = key;
+}
+
+void BindVertexShader(Buffer& buffer, RenderPass::VertexShader shader)
+{
+	buffer.vertex_shader = shader;
+}
+
+void BindFragmentShader(Buffer& buffer, RenderPass::FragmentShader shader)
+{
+	buffer.fragment_shader = shader;
+}
+
+void BindPipelineState(Buffer& buffer, const RenderPass::PipelineState& state)
+{
+	buffer.pipeline_state = state;
+}
+
+void BindUniformBlock(Buffer& buffer, const UniformBlock* uniforms)
+{
+	buffer.uniforms = uniforms;
+}
+
+void Clear(Buffer& buffer, Color color)
+{
+	ClearCommand* command = (ClearCommand*)Allocate(buffer, CommandType::Clear, sizeof(ClearCommand));
+	command->color = color;
+}
+
+static void RecordDraw(Buffer& buffer, void* vertex_buffer, const void* indices, uint32_t num_elements, RenderPass::IndexType index_type, void* instance_buffer, uint16_t num_instances, const std::array<RenderPass::VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride)
+{
+	// Only the attributes in use are stored, right after the command
+	uint32_t attributes_size = sizeof(RenderPass::VertexAttribute) * num_attributes;
+	DrawCommand* command = (DrawCommand*)Allocate(buffer, CommandType::Draw, sizeof(DrawCommand) + attributes_size);
+	command->vertex_shader = buffer.vertex_shader;
+	command->fragment_shader = buffer.fragment_shader;
+	command->uniforms = buffer.uniforms;
+	command->pipeline_state = buffer.pipeline_state;
+	command->vertex_buffer = vertex_buffer;
+	command->instance_buffer = instance_buffer;
+	command->indices = indices;
+	command->num_elements = num_elements;
+	command->index_type = index_type;
+	command->num_instances = num_instances;
+	command->num_attributes = num_attributes;
+	command->stride = stride;
+	command->instance_stride = instance_stride;
+	memcpy((void*)(command + 1), attributes.data(), attributes_size);
+}
+
+void DrawArrays(Buffer& buffer, void* vertex_buffer, uint16_t num_vertices, const std::array<RenderPass::VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride)
+{
+	RecordDraw(buffer, vertex_buffer, nullptr, num_vertices, RenderPass::IndexType::UInt16, nullptr, 1, attributes, num_attributes, stride, 0);
+}
+
+void DrawArraysInstanced(Buffer& buffer, void* vertex_buffer, uint16_t num_vertices, void* instance_buffer, uint16_t num_instances, const std::array<RenderPass::VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride)
+{
+	RecordDraw(buffer, vertex_buffer, nullptr, num_vertices, RenderPass::IndexType::UInt16, instance_buffer, num_instances, attributes, num_attributes, stride, instance_stride);
+}
+
+void DrawElements(Buffer& buffer, void* vertex_buffer, const void* indices, uint32_t num_indices, RenderPass::IndexType index_type, const std::array<RenderPass::VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride)
+{
+	RecordDraw(buffer, vertex_buffer, indices, num_indices, index_type, nullptr, 1, attributes, num_attributes, stride, 0);
+}
+
+void DrawElementsInstanced(Buffer& buffer, void* vertex_buffer, const void* indices, uint32_t num_indices, RenderPass::IndexType index_type, void* instance_buffer, uint16_t num_instances, const std::array<RenderPass::VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride)
+{
+	RecordDraw(buffer, vertex_buffer, indices, num_indices, index_type, instance_buffer, num_instances, attributes, num_attributes, stride, instance_stride);
+}
+
+// Clears go first, then everything else by key. Ties are broken by the order given by the caller
+static bool ComesBefore(const CommandHeader* a, const CommandHeader* b)
+{
+	bool a_clear = a->type == CommandType::Clear;
+	bool b_clear = b->type == CommandType::Clear;
+	if (a_clear != b_clear)
+		return a_clear;
+	return a->sort_key < b->sort_key;
+}
+
+void Sort(Buffer& buffer)
+{
+	const unsigned char* memory = buffer.memory.data();
+	std::stable_sort(buffer.offsets.begin(), buffer.offsets.end(), [memory](uint32_t a, uint32_t b)
+	{
+		return ComesBefore((const CommandHeader*)(memory + a), (const CommandHeader*)(memory + b));
+	});
+}
+
+// Pipeline states are immutable, so the same raster functions, cull mode and topology means the same state
+static bool IsSameState(const RenderPass::PipelineState& a, const RenderPass::PipelineState& b)
+{
+	return a.raster_first_type == b.raster_first_type && a.raster_second_type == b.raster_second_type && a.desc.cull_mode == b.desc.cull_mode && a.desc.topology == b.desc.topology;
+}
+
+static void Execute(const CommandHeader* header, RenderPass::VertexShader& bound_shader, RenderPass::FragmentShader& bound_fragment_shader, const UniformBlock*& bound_uniforms)
+{
+	switch (header->type)
+	{
+	case CommandType::Clear:
+	{
+		const ClearCommand* command = (const ClearCommand*)header;
+		Canvas::Clear(command->color);
+		break;
+	}
+	case CommandType::Draw:
+	{
+		const DrawCommand* command = (const DrawCommand*)header;
+		// Only touch the pipeline state when it actually changes
+		if (command->vertex_shader != bound_shader)
+		{
+			RenderPass::BindVertexShader(command->vertex_shader);
+			bound_shader = command->vertex_shader;
+		}
+		if (command->fragment_shader != bound_fragment_shader)
+		{
+			RenderPass::BindFragmentShader(command->fragment_shader);
+			bound_fragment_shader = command->fragment_shader;
+		}
+		if (command->uniforms != bound_uniforms)
+		{
+			RenderPass::BindUniformBlock(command->uniforms);
+			bound_uniforms = command->uniforms;
+		}
+		if (!IsSameState(command->pipeline_state, RenderPass::GetPipelineState()))
+			RenderPass::BindPipelineState(command->pipeline_state);
+
+		std::array<RenderPass::VertexAttribute, 16> attributes;
+		memcpy((void*)attributes.data(), command + 1, sizeof(RenderPass::VertexAttribute) * command->num_attributes);
+		// Plain draws are recorded as one instance, so every draw replays as an instanced one : instanced draws without
+		// per instance attributes have no instance buffer, but still need all of their instances
+		if (command->indices)
+			RenderPass::DrawElementsInstanced((void*)command->vertex_buffer, command->indices, command->num_elements, command->index_type, (void*)command->instance_buffer, command->num_instances, attributes, command->num_attributes, command->stride, command->instance_stride);
+		else
+			RenderPass::DrawArraysInstanced((void*)command->vertex_buffer, (uint16_t)command->num_elements, (void*)command->instance_buffer, command->num_instances, attributes, command->num_attributes, command->stride, command->instance_stride);
+		break;
+	}
+	}
+}
+
+void Submit(const Buffer& buffer)
+{
+	Submit(&buffer, 1);
+}
+
+void Submit(const Buffer* buffers, int num_buffers)
+{
+	// Gather every command, then merge the buffers by key.
+	// The buffers are expected to be sorted already, so ties stay in buffer order, then recording order
+	std::vector<const CommandHeader*> commands;
+	for (int i = 0; i < num_buffers; ++i)
+	{
+		for (uint32_t offset : buffers[i].offsets)
+		{
+			commands.push_back((const CommandHeader*)(buffers[i].memory.data() + offset));
+		}
+	}
+	if (num_buffers > 1)
+		std::stable_sort(commands.begin(), commands.end(), ComesBefore);
+
+	RenderPass::VertexShader bound_shader = nullptr;
+	RenderPass::FragmentShader bound_fragment_shader = nullptr;
+	const UniformBlock* bound_uniforms = nullptr;
+	RenderPass::BindVertexShader(nullptr);
+	RenderPass::BindFragmentShader(nullptr);
+	RenderPass::BindUniformBlock(nullptr);
+	for (const CommandHeader* header : commands)
+	{
+		Execute(header, bound_shader, bound_fragment_shader, bound_uniforms);
+	}
+}
+
+}
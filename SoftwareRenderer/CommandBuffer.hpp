@@ -0,0 +1,71 @@
+#ifndef COMMAND_BUFFER_HPP
+#define COMMAND_BUFFER_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "Canvas.hpp"
+#include "RenderPass.hpp"
+
+// Command buffers record clears, state and draws into one linear block of memory, to be replayed later by the renderer.
+// A buffer is only ever touched by the thread recording it, so every thread can record its own buffer in parallel
+// and the render thread submits them all at once. Recorded buffers can also be kept around and replayed (frame capture).
+namespace CommandBuffer {
+
+enum class CommandType : uint16_t
+{
+	Clear,
+	Draw
+};
+
+// Every command starts with this header, followed by its own data
+struct CommandHeader
+{
+	CommandType type;
+	uint16_t size; // in bytes, header included
+	uint32_t sort_key;
+};
+
+struct Buffer
+{
+	std::vector<unsigned char> memory;
+	std::vector<uint32_t> offsets; // Where each command starts in memory, in execution order
+
+	// State captured by the commands being recorded
+	uint32_t sort_key = 0;
+	RenderPass::VertexShader vertex_shader = nullptr;
+	RenderPass::FragmentShader fragment_shader = nullptr;
+	const UniformBlock* uniforms = nullptr;
+	RenderPass::PipelineState pipeline_state = RenderPass::CreatePipelineState(RenderPass::PipelineStateDesc());
+};
+
+// Forget every recorded command and reset the recording state
+void Reset(Buffer& buffer);
+
+// The key given to the following draws. Sort orders draws by this key (eg. by state or by depth)
+void SetSortKey(Buffer& buffer, uint32_t key);
+// Draws recorded after these will be replayed with this shader (or pipeline state), wherever sorting moves them
+void BindVertexShader(Buffer& buffer, RenderPass::VertexShader shader);
+void BindFragmentShader(Buffer& buffer, RenderPass::FragmentShader shader);
+void BindPipelineState(Buffer& buffer, const RenderPass::PipelineState& state);
+// The block is referenced, not copied : it must stay alive (and unchanged) until the buffer is submitted
+void BindUniformBlock(Buffer& buffer, const UniformBlock* uniforms);
+
+// Clears are always executed before the draws once the buffer is sorted
+void Clear(Buffer& buffer, Color color);
+void DrawArrays(Buffer& buffer, void* vertex_buffer, uint16_t num_vertices, const std::array<RenderPass::VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride);
+void DrawArraysInstanced(Buffer& buffer, void* vertex_buffer, uint16_t num_vertices, void* instance_buffer, uint16_t num_instances, const std::array<RenderPass::VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride);
+void DrawElements(Buffer& buffer, void* vertex_buffer, const void* indices, uint32_t num_indices, RenderPass::IndexType index_type, const std::array<RenderPass::VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride);
+void DrawElementsInstanced(Buffer& buffer, void* vertex_buffer, const void* indices, uint32_t num_indices, RenderPass::IndexType index_type, void* instance_buffer, uint16_t num_instances, const std::array<RenderPass::VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride);
+
+// Reorder the commands of a buffer by sort key. Commands with the same key keep their recording order
+void Sort(Buffer& buffer);
+
+// Replay the commands of one buffer in their current order
+void Submit(const Buffer& buffer);
+// Replay several buffers (eg. one per recording thread) merged together by sort key
+void Submit(const Buffer* buffers, int num_buffers);
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include "MappedFile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(view, other.view);
+		std::swap(view_size, other.view_size);
+		std::swap(is_open, other.is_open);
+#ifdef _WIN32
+		std::swap(file_handle, other.file_handle);
+		std::swap(mapping_handle, other.mapping_handle);
+#endif
+	}
+	return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	is_open = true;
+	if (file_size.QuadPart == 0)
+		return true;
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+	mapping_handle = mapping;
+
+	view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		close();
+		return false;
+	}
+	view_size = (size_t)file_size.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (view)
+		UnmapViewOfFile(view);
+	if (mapping_handle)
+		CloseHandle(mapping_handle);
+	if (file_handle)
+		CloseHandle(file_handle);
+	view = nullptr;
+	view_size = 0;
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+	is_open = false;
+}
+
+#else
+
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+	int file = ::open(filename.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat file_stat;
+	if (fstat(file, &file_stat) != 0)
+	{
+		::close(file);
+		return false;
+	}
+	is_open = true;
+	if (file_stat.st_size == 0)
+	{
+		::close(file);
+		return true;
+	}
+
+	// The mapping stays valid once the descriptor is closed
+	void* mapping = mmap(nullptr, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (mapping == MAP_FAILED)
+	{
+		is_open = false;
+		return false;
+	}
+	madvise(mapping, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+
+	view = (const char*)mapping;
+	view_size = (size_t)file_stat.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (view)
+		munmap((void*)view, view_size);
+	view = nullptr;
+	view_size = 0;
+	is_open = false;
+}
+
+#endif
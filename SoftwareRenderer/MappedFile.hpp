@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file.
+// The OS pages the file in on demand, nothing is copied into our own buffers.
+class MappedFile {
+public:
+	MappedFile() {}
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(MappedFile&& other);
+
+	// Returns false if the file could not be opened or mapped. Empty files map to a null, zero sized view
+	bool open(const std::string& filename);
+	void close();
+
+	bool isOpen() const { return is_open; }
+	const char* data() const { return view; }
+	size_t size() const { return view_size; }
+
+private:
+	const char* view = nullptr;
+	size_t view_size = 0;
+	bool is_open = false;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+};
+
+#endif
@@ -1,118 +1,1013 @@
-
 #include "MeshLoader.hpp"
 
+#include <algorithm>
 #include <iostream>
-#include <fstream>
 #include <cassert>
-#include <sstream>
-#include <functional>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "MappedFile.hpp"
+#include "MeshOptimizer.hpp"
 
 namespace MeshLoader {
 
-static std::vector<std::string> splitByRegex(const std::string& string, char regex) {
-	std::stringstream ss;
-	ss.str(string);
-	std::string item;
+// Raw records of an OBJ file.
+// Face corners are stored as (v, vt, vn) triplets of 0-based indices, -1 when a corner has no texCoord or normal.
+struct ObjData
+{
+	std::vector<float> positions; // xyz
+	std::vector<float> texCoords; // uv
+	std::vector<float> normals;   // xyz
+	std::vector<int> corners;     // 3 corners per triangle
+
+	// When parsing a chunk of the file, negative (relative) indices can only be resolved against the chunk's own records.
+	// These are the positions in corners of such indices, fixed up once the records of the previous chunks are counted.
+	std::vector<size_t> relative_corners;
+};
+
+// ------------------------
+// In place parsing, the file is scanned straight from its memory mapping without any copy or allocation per line
+// ------------------------
+
+static inline const char* SkipSpaces(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		++p;
+	return p;
+}
+
+static inline bool IsDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+// Hand rolled, std::from_chars for floats is not available on every compiler we build with yet
+static const char* ParseFloat(const char* p, const char* end, float& value)
+{
+	static const double powers_of_10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	p = SkipSpaces(p, end);
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		++p;
+	}
+
+	// Up to 19 significant digits fit in the mantissa, the others only move the exponent
+	uint64_t mantissa = 0;
+	int significant_digits = 0;
+	int exponent = 0;
+	for (; p < end && IsDigit(*p); ++p)
+	{
+		if (significant_digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa)
+				++significant_digits;
+		}
+		else
+		{
+			++exponent;
+		}
+	}
+	if (p < end && *p == '.')
+	{
+		for (++p; p < end && IsDigit(*p); ++p)
+		{
+			if (significant_digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa)
+					++significant_digits;
+				--exponent;
+			}
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		int explicit_exponent = 0;
+		std::from_chars_result result = std::from_chars(p + 1 + (p + 1 < end && p[1] == '+'), end, explicit_exponent);
+		if (result.ec == std::errc())
+		{
+			exponent += explicit_exponent;
+			p = result.ptr;
+		}
+	}
+
+	double result = (double)mantissa;
+	if (exponent < 0)
+		result = exponent >= -22 ? result / powers_of_10[-exponent] : result * std::pow(10.0, exponent);
+	else if (exponent > 0)
+		result = exponent <= 22 ? result * powers_of_10[exponent] : result * std::pow(10.0, exponent);
+	value = (float)(negative ? -result : result);
+	return p;
+}
+
+// Parses up to count floats of a v, vt or vn record
+static void ParseFloats(const char* p, const char* end, std::vector<float>& output, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		float value = 0;
+		p = ParseFloat(p, end, value);
+		output.push_back(value);
+	}
+}
+
+// OBJ indices are 1-based, or relative to the end of the list when negative
+static inline int ResolveIndex(int index, int count)
+{
+	if (index > 0)
+		return index - 1;
+	if (index < 0)
+		return count + index;
+	return -1;
+}
+
+// Parses one v, v/vt, v//vn or v/vt/vn face corner. Sets a bit of relative_mask for every negative index
+static const char* ParseCorner(const char* p, const char* end, const int counts[3], int corner[3], int& relative_mask)
+{
+	corner[0] = corner[1] = corner[2] = -1;
+	relative_mask = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		int index = 0;
+		std::from_chars_result result = std::from_chars(p, end, index);
+		if (result.ec == std::errc())
+		{
+			corner[i] = ResolveIndex(index, counts[i]);
+			if (index < 0)
+				relative_mask |= 1 << i;
+			p = result.ptr;
+		}
+		if (p >= end || *p != '/')
+			break;
+		++p;
+	}
+	return p;
+}
+
+static void ParseFace(const char* p, const char* end, const int counts[3], ObjData& data)
+{
+	// Polygons are split into a fan of triangles
+	int first[3], previous[3], current[3];
+	int first_mask = 0, previous_mask = 0, current_mask = 0;
+	int num_corners = 0;
+	auto PushCorner = [&data](const int corner[3], int relative_mask)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			if (relative_mask & (1 << i))
+				data.relative_corners.push_back(data.corners.size());
+			data.corners.push_back(corner[i]);
+		}
+	};
+	while (true)
+	{
+		p = SkipSpaces(p, end);
+		if (p >= end)
+			break;
+		const char* corner_end = ParseCorner(p, end, counts, current, current_mask);
+		if (corner_end == p)
+			break;
+		p = corner_end;
+
+		if (num_corners == 0)
+		{
+			memcpy(first, current, sizeof(first));
+			first_mask = current_mask;
+		}
+		else if (num_corners >= 2)
+		{
+			PushCorner(first, first_mask);
+			PushCorner(previous, previous_mask);
+			PushCorner(current, current_mask);
+		}
+		memcpy(previous, current, sizeof(previous));
+		previous_mask = current_mask;
+		++num_corners;
+	}
+}
+
+static void ParseLine(const char* p, const char* end, ObjData& data)
+{
+	p = SkipSpaces(p, end);
+	// Ignore empty lines and comments
+	if (end - p < 2 || *p == '#')
+		return;
+
+	if (p[0] == 'v' && p[1] == ' ')
+	{
+		ParseFloats(p + 2, end, data.positions, 3);
+	}
+	else if (p[0] == 'v' && p[1] == 't' && end - p >= 3 && p[2] == ' ')
+	{
+		ParseFloats(p + 3, end, data.texCoords, 2);
+	}
+	else if (p[0] == 'v' && p[1] == 'n' && end - p >= 3 && p[2] == ' ')
+	{
+		ParseFloats(p + 3, end, data.normals, 3);
+	}
+	else if (p[0] == 'f' && p[1] == ' ')
+	{
+		int counts[3] = { (int)data.positions.size() / 3, (int)data.texCoords.size() / 2, (int)data.normals.size() / 3 };
+		ParseFace(p + 2, end, counts, data);
+	}
+}
+
+static void ParseObj(const char* begin, const char* end, ObjData& data)
+{
+	const char* line = begin;
+	while (line < end)
+	{
+		const char* line_end = (const char*)memchr(line, '\n', end - line);
+		if (line_end == nullptr)
+			line_end = end;
+		ParseLine(line, line_end, data);
+		line = line_end + 1;
+	}
+}
+
+// ------------------------
+// Parallel parsing : the file is cut in chunks at line boundaries, parsed on every core, then merged
+// ------------------------
+
+// Below this, starting threads costs more than it saves
+static const size_t min_chunk_size = 1 << 20;
+
+template <typename Function>
+static void RunOnWorkers(int num_workers, const Function& function)
+{
+	std::vector<std::thread> workers;
+	for (int i = 1; i < num_workers; ++i)
+	{
+		workers.emplace_back(function, i);
+	}
+	function(0);
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+// Every corner needs a position : an index of 0, a missing one or one past the v records makes the file invalid.
+// Indices can only be checked once resolved, positive ones in a chunk may point to the records of the previous chunks
+static bool HasValidPositions(const ObjData& data, size_t first_corner, size_t last_corner)
+{
+	int num_positions = (int)data.positions.size() / 3;
+	for (size_t i = first_corner; i < last_corner; i += 3)
+	{
+		if (data.corners[i] < 0 || data.corners[i] >= num_positions)
+			return false;
+	}
+	return true;
+}
+
+// Returns false if a face references a position that does not exist
+static bool ParseObjParallel(const char* begin, const char* end, ObjData& data)
+{
+	size_t size = end - begin;
+	int num_chunks = (int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), size / min_chunk_size + 1);
+	if (num_chunks == 1)
+	{
+		ParseObj(begin, end, data);
+		return HasValidPositions(data, 0, data.corners.size());
+	}
+
+	// Cut the file in roughly equal chunks, each ending right after a new line
+	std::vector<const char*> boundaries(num_chunks + 1);
+	boundaries[0] = begin;
+	boundaries[num_chunks] = end;
+	for (int i = 1; i < num_chunks; ++i)
+	{
+		const char* cut = std::max(boundaries[i - 1], begin + size * i / num_chunks);
+		const char* line_end = (const char*)memchr(cut, '\n', end - cut);
+		boundaries[i] = line_end ? line_end + 1 : end;
+	}
+
+	std::vector<ObjData> chunks(num_chunks);
+	RunOnWorkers(num_chunks, [&](int i)
+	{
+		ParseObj(boundaries[i], boundaries[i + 1], chunks[i]);
+	});
 
-	std::vector<std::string> result;
-	while (std::getline(ss, item, regex)) {
-		result.push_back(item);
+	// Prefix sums of the record counts give where every chunk goes in the merged arrays
+	std::vector<size_t> position_offsets(num_chunks + 1, 0);
+	std::vector<size_t> texCoord_offsets(num_chunks + 1, 0);
+	std::vector<size_t> normal_offsets(num_chunks + 1, 0);
+	std::vector<size_t> corner_offsets(num_chunks + 1, 0);
+	for (int i = 0; i < num_chunks; ++i)
+	{
+		position_offsets[i + 1] = position_offsets[i] + chunks[i].positions.size();
+		texCoord_offsets[i + 1] = texCoord_offsets[i] + chunks[i].texCoords.size();
+		normal_offsets[i + 1] = normal_offsets[i] + chunks[i].normals.size();
+		corner_offsets[i + 1] = corner_offsets[i] + chunks[i].corners.size();
 	}
-	return result;	
+	data.positions.resize(position_offsets[num_chunks]);
+	data.texCoords.resize(texCoord_offsets[num_chunks]);
+	data.normals.resize(normal_offsets[num_chunks]);
+	data.corners.resize(corner_offsets[num_chunks]);
+
+	// Not a vector<bool>, every worker writes its own element
+	std::vector<char> valid_chunks(num_chunks);
+	RunOnWorkers(num_chunks, [&](int i)
+	{
+		ObjData& chunk = chunks[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), data.positions.begin() + position_offsets[i]);
+		std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), data.texCoords.begin() + texCoord_offsets[i]);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + normal_offsets[i]);
+
+		// Relative indices were resolved against this chunk only, shift them past the records of the previous chunks
+		int record_offsets[3] = { (int)position_offsets[i] / 3, (int)texCoord_offsets[i] / 2, (int)normal_offsets[i] / 3 };
+		for (size_t corner : chunk.relative_corners)
+		{
+			chunk.corners[corner] += record_offsets[corner % 3];
+		}
+		std::copy(chunk.corners.begin(), chunk.corners.end(), data.corners.begin() + corner_offsets[i]);
+		valid_chunks[i] = HasValidPositions(data, corner_offsets[i], corner_offsets[i + 1]);
+	});
+	return std::find(valid_chunks.begin(), valid_chunks.end(), 0) == valid_chunks.end();
 }
-template <typename T>
-static std::vector<T> split(const std::string& string, int start, char regex, std::function<double(const char*)> Convert)
+
+// Interlace the data to be VTNVTNVTN...
+// Position indices must have been checked with HasValidPositions, missing texCoords and normals are zeroed
+static void Interleave(const ObjData& data, size_t first_corner, size_t last_corner, float* vertex)
 {
-	std::vector<std::string> strs = splitByRegex(string, regex);
-	std::vector<T> result;
-	for (int i = start; i < strs.size(); ++i)
+	int num_texCoords = (int)data.texCoords.size() / 2;
+	int num_normals = (int)data.normals.size() / 3;
+
+	for (size_t i = first_corner; i < last_corner; i += 3, vertex += 8)
 	{
-		result.push_back(Convert(strs[i].c_str()));
+		const int* corner = &data.corners[i];
+		// V
+		memcpy(vertex + 0, &data.positions[corner[0] * 3], sizeof(float) * 3);
+		// T
+		if (corner[1] >= 0 && corner[1] < num_texCoords)
+			memcpy(vertex + 3, &data.texCoords[corner[1] * 2], sizeof(float) * 2);
+		else
+			vertex[3] = vertex[4] = 0;
+		// N
+		if (corner[2] >= 0 && corner[2] < num_normals)
+			memcpy(vertex + 5, &data.normals[corner[2] * 3], sizeof(float) * 3);
+		else
+			vertex[5] = vertex[6] = vertex[7] = 0;
 	}
-	return result;
+}
+
+static std::vector<float> Interleave(const ObjData& data)
+{
+	size_t num_vertices = data.corners.size() / 3;
+	std::vector<float> vertex_buffer(num_vertices * 8);
+
+	// Each worker writes its own range of vertices
+	int num_workers = (int)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), num_vertices * 8 * sizeof(float) / min_chunk_size + 1);
+	RunOnWorkers(num_workers, [&](int i)
+	{
+		size_t first = num_vertices * i / num_workers;
+		size_t last = num_vertices * (i + 1) / num_workers;
+		Interleave(data, first * 3, last * 3, vertex_buffer.data() + first * 8);
+	});
+	return vertex_buffer;
+}
+
+// ------------------------
+// Vertex deduplication
+// ------------------------
+
+static inline uint32_t HashCorner(const int* corner)
+{
+	uint32_t hash = (uint32_t)corner[0] * 73856093u;
+	hash ^= (uint32_t)corner[1] * 19349663u;
+	hash ^= (uint32_t)corner[2] * 83492791u;
+	return hash ^ (hash >> 15);
+}
+
+// Gives every unique (v, vt, vn) corner an index, in order of first use.
+// unique_corners gets the first corner of every unique vertex
+static std::vector<uint32_t> DeduplicateCorners(const ObjData& data, std::vector<size_t>& unique_corners)
+{
+	size_t num_corners = data.corners.size() / 3;
+
+	// Open addressing hash table of unique vertex indices, kept under half full
+	size_t table_size = 64;
+	while (table_size < num_corners * 2)
+		table_size *= 2;
+	std::vector<uint32_t> table(table_size, ~0u);
+	size_t mask = table_size - 1;
+
+	std::vector<uint32_t> indices(num_corners);
+	unique_corners.clear();
+	for (size_t i = 0; i < num_corners; ++i)
+	{
+		const int* corner = &data.corners[i * 3];
+		size_t slot = HashCorner(corner) & mask;
+		while (true)
+		{
+			uint32_t vertex = table[slot];
+			if (vertex == ~0u)
+			{
+				// New vertex
+				vertex = (uint32_t)unique_corners.size();
+				unique_corners.push_back(i * 3);
+				table[slot] = vertex;
+				indices[i] = vertex;
+				break;
+			}
+			if (memcmp(&data.corners[unique_corners[vertex]], corner, sizeof(int) * 3) == 0)
+			{
+				indices[i] = vertex;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
+	}
+	return indices;
+}
+
+static bool ParseFile(const std::string& filename, ObjData& data)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cerr << "Error: Could not open mesh file " << filename << std::endl;
+		return false;
+	}
+
+	if (!ParseObjParallel(file.data(), file.data() + file.size(), data))
+	{
+		std::cerr << "Error: A face references a missing vertex in mesh file " << filename << std::endl;
+		data = ObjData();
+		return false;
+	}
+	return true;
 }
 
 std::vector<float> LoadMesh(const std::string& filename, int& num_vertices)
 {
-	std::ifstream file;
-	file.open(filename);
+	num_vertices = 0;
+
+	ObjData data;
+	if (!ParseFile(filename, data))
+		return std::vector<float>();
+
+	num_vertices = (int)data.corners.size() / 3;
+	return Interleave(data);
+}
+
+bool LoadMeshIndexed(const std::string& filename, IndexedMesh& mesh)
+{
+	mesh = IndexedMesh();
+
+	ObjData data;
+	if (!ParseFile(filename, data))
+		return false;
+
+	std::vector<size_t> unique_corners;
+	std::vector<uint32_t> indices = DeduplicateCorners(data, unique_corners);
+
+	// Only the unique vertices are interleaved
+	mesh.num_vertices = (int)unique_corners.size();
+	mesh.vertices.resize(unique_corners.size() * 8);
+	for (size_t i = 0; i < unique_corners.size(); ++i)
+	{
+		Interleave(data, unique_corners[i], unique_corners[i] + 3, &mesh.vertices[i * 8]);
+	}
+
+	mesh.num_indices = (int)indices.size();
+	if (mesh.uses16BitIndices())
+		mesh.indices16.assign(indices.begin(), indices.end());
+	else
+		mesh.indices32 = std::move(indices);
+	return true;
+}
+
+// ------------------------
+// Streaming
+// ------------------------
+
+bool StreamMesh(const std::string& filename, int batch_vertices, const MeshBatchCallback& callback)
+{
+	batch_vertices -= batch_vertices % 3;
+	assert(batch_vertices >= 3);
+
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cerr << "Error: Could not open mesh file " << filename << std::endl;
+		return false;
+	}
+
+	ObjData data;
+	std::vector<float> batch((size_t)batch_vertices * 8);
+	int num_batched = 0;
+
+	const char* line = file.data();
+	const char* end = file.data() + file.size();
+	while (line < end)
+	{
+		const char* line_end = (const char*)memchr(line, '\n', end - line);
+		if (line_end == nullptr)
+			line_end = end;
+		ParseLine(line, line_end, data);
+		line = line_end + 1;
+
+		// Faces can only reference the positions read so far
+		if (!HasValidPositions(data, 0, data.corners.size()))
+		{
+			std::cerr << "Error: A face references a missing vertex in mesh file " << filename << std::endl;
+			return false;
+		}
+
+		// Faces go straight into the batch and are forgotten
+		for (size_t i = 0; i < data.corners.size(); i += 9)
+		{
+			if (num_batched == batch_vertices)
+			{
+				callback(batch.data(), num_batched);
+				num_batched = 0;
+			}
+			Interleave(data, i, i + 9, &batch[(size_t)num_batched * 8]);
+			num_batched += 3;
+		}
+		data.corners.clear();
+		data.relative_corners.clear();
+	}
+
+	if (num_batched)
+		callback(batch.data(), num_batched);
+	return true;
+}
+
+// ------------------------
+// Binary mesh cache
+// ------------------------
+
+static const uint32_t mesh_cache_magic = 0x48534D53; // "SMSH"
+static const uint32_t mesh_cache_version = 2;
+
+static inline uint64_t AlignTo16(uint64_t offset)
+{
+	return (offset + 15) & ~uint64_t(15);
+}
+
+// Size and modification time of the source file, to know when a cache is out of date
+static bool GetSourceStamp(const std::string& filename, uint64_t& size, int64_t& time)
+{
+	std::error_code error;
+	size = std::filesystem::file_size(filename, error);
+	if (error)
+		return false;
+	time = (int64_t)std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+	return !error;
+}
+
+// Bounding box of the positions
+static void ComputeBounds(const IndexedMesh& mesh, float bounds_min[3], float bounds_max[3])
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		bounds_min[i] = bounds_max[i] = mesh.num_vertices ? mesh.vertices[i] : 0;
+	}
+	for (int v = 0; v < mesh.num_vertices; ++v)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			bounds_min[i] = std::min(bounds_min[i], mesh.vertices[v * 8 + i]);
+			bounds_max[i] = std::max(bounds_max[i], mesh.vertices[v * 8 + i]);
+		}
+	}
+}
+
+std::string GetMeshCacheFilename(const std::string& filename)
+{
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return filename + ".srmesh";
+	return filename.substr(0, dot) + ".srmesh";
+}
+
+bool WriteMeshCache(const std::string& filename, const IndexedMesh& mesh)
+{
+	MeshFileHeader header = {};
+	header.magic = mesh_cache_magic;
+	header.version = mesh_cache_version;
+	if (!GetSourceStamp(filename, header.source_size, header.source_time))
+		return false;
+	header.num_vertices = mesh.num_vertices;
+	header.num_indices = (uint32_t)(mesh.uses16BitIndices() ? mesh.indices16.size() : mesh.indices32.size());
+	header.num_lods = (uint32_t)mesh.lods.size();
+	header.vertex_stride = 8;
+	header.index_size = mesh.uses16BitIndices() ? 2 : 4;
+
+	ComputeBounds(mesh, header.bounds_min, header.bounds_max);
+
+	uint64_t vertices_size = sizeof(float) * mesh.vertices.size();
+	uint64_t indices_size = (uint64_t)header.index_size * header.num_indices;
+	uint64_t lods_size = sizeof(MeshLOD) * mesh.lods.size();
+	header.vertex_offset = AlignTo16(sizeof(MeshFileHeader));
+	header.index_offset = AlignTo16(header.vertex_offset + vertices_size);
+	header.lod_offset = AlignTo16(header.index_offset + indices_size);
+
+	std::ofstream file(GetMeshCacheFilename(filename), std::ios::binary | std::ios::trunc);
 	if (!file.good())
-		assert(!"Failed to load mesh input file!");
+		return false;
 
-	// Store vertex data
-	std::vector<float> vertices_;
-	std::vector<float> texCoords_;
-	std::vector<float> normals_;
+	static const char padding[16] = {};
+	file.write((const char*)&header, sizeof(header));
+	file.write(padding, header.vertex_offset - sizeof(header));
+	file.write((const char*)mesh.vertices.data(), vertices_size);
+	file.write(padding, header.index_offset - (header.vertex_offset + vertices_size));
+	file.write((const char*)mesh.indexData(), indices_size);
+	file.write(padding, header.lod_offset - (header.index_offset + indices_size));
+	file.write((const char*)mesh.lods.data(), lods_size);
+	return file.good();
+}
 
-	// Final vertex values
-	std::vector<float> vertices;
-	std::vector<float> texCoords;
-	std::vector<float> normals;
+// Points the mesh into its mapped cache file, if that file is a valid and up to date cache of the source
+static bool MapMeshCache(const std::string& filename, CachedMesh& mesh)
+{
+	uint64_t source_size;
+	int64_t source_time;
+	if (!GetSourceStamp(filename, source_size, source_time))
+		return false;
 
-	std::string line;
-	while (std::getline(file, line))
+	if (!mesh.file.open(GetMeshCacheFilename(filename)) || mesh.file.size() < sizeof(MeshFileHeader))
+		return false;
+
+	const MeshFileHeader* header = (const MeshFileHeader*)mesh.file.data();
+	if (header->magic != mesh_cache_magic || header->version != mesh_cache_version)
+		return false;
+	if (header->source_size != source_size || header->source_time != source_time)
+		return false;
+	if (header->vertex_stride != 8 || (header->index_size != 2 && header->index_size != 4))
+		return false;
+	if (header->vertex_offset % 16 || header->index_offset % 16 || header->lod_offset % 16)
+		return false;
+	if (header->vertex_offset + sizeof(float) * 8 * (uint64_t)header->num_vertices > mesh.file.size())
+		return false;
+	if (header->index_offset + (uint64_t)header->index_size * header->num_indices > mesh.file.size())
+		return false;
+	if (header->lod_offset + sizeof(MeshLOD) * (uint64_t)header->num_lods > mesh.file.size())
+		return false;
+	const MeshLOD* lods = (const MeshLOD*)(mesh.file.data() + header->lod_offset);
+	for (uint32_t i = 0; i < header->num_lods; ++i)
 	{
-		// Ignore empty lines
-		if (line == "")
-			continue;
-		// Ignore comments
-		if (line[0] == '#')
-			continue;
+		if ((uint64_t)lods[i].index_offset + lods[i].num_indices > header->num_indices)
+			return false;
+	}
 
-		if (line.length() >= 2 && line.substr(0, 2) == "v ")
+	mesh.vertices = (const float*)(mesh.file.data() + header->vertex_offset);
+	mesh.num_vertices = header->num_vertices;
+	mesh.indices = mesh.file.data() + header->index_offset;
+	mesh.num_indices = header->num_lods ? lods[0].num_indices : header->num_indices;
+	mesh.uses_16bit_indices = header->index_size == 2;
+	mesh.lods = header->num_lods ? lods : nullptr;
+	mesh.num_lods = header->num_lods;
+	memcpy(mesh.bounds_min, header->bounds_min, sizeof(mesh.bounds_min));
+	memcpy(mesh.bounds_max, header->bounds_max, sizeof(mesh.bounds_max));
+	return true;
+}
+
+bool LoadMeshCached(const std::string& filename, CachedMesh& mesh)
+{
+	if (MapMeshCache(filename, mesh))
+		return true;
+	mesh.file.close();
+
+	// First load (or stale cache) : parse the OBJ, then write the cache for next time
+	IndexedMesh indexed;
+	if (!LoadMeshIndexed(filename, indexed))
+		return false;
+	MeshOptimizer::GenerateLODs(indexed);
+	if (WriteMeshCache(filename, indexed) && MapMeshCache(filename, mesh))
+		return true;
+	mesh.file.close();
+
+	// The cache could not be written (eg. read only directory), keep the parsed mesh instead
+	mesh.fallback = std::move(indexed);
+	const IndexedMesh& fallback = mesh.fallback;
+	mesh.vertices = fallback.vertices.data();
+	mesh.num_vertices = fallback.num_vertices;
+	mesh.indices = fallback.indexData();
+	mesh.num_indices = fallback.num_indices;
+	mesh.uses_16bit_indices = fallback.uses16BitIndices();
+	mesh.lods = fallback.lods.empty() ? nullptr : fallback.lods.data();
+	mesh.num_lods = (int)fallback.lods.size();
+	ComputeBounds(fallback, mesh.bounds_min, mesh.bounds_max);
+	return true;
+}
+
+// ------------------------
+// Asynchronous loading
+// ------------------------
+
+// Loads are mostly waiting on the disk (and parse on their own workers when they do parse), a couple of threads is enough
+static const int num_io_threads = 2;
+
+struct AsyncMesh
+{
+	std::string filename;
+	LoadState state = LoadState::Pending;
+	CachedMesh mesh;
+};
+
+// Background I/O threads, started with the first load and joined when the program exits
+class IOThreadPool
+{
+public:
+	~IOThreadPool()
+	{
 		{
-			std::vector<float> dvertices = split<float>(line, 1, ' ', std::atof);
-			vertices_.push_back(dvertices[0]);
-			vertices_.push_back(dvertices[1]);
-			vertices_.push_back(dvertices[2]);
+			std::lock_guard<std::mutex> lock(mutex);
+			exiting = true;
 		}
-		else if (line.length() >= 3 && line.substr(0, 3) == "vt ")
+		work_available.notify_all();
+		for (std::thread& thread : threads)
 		{
-			std::vector<float> dtexcoords = split<float>(line, 1, ' ', std::atof);
-			texCoords_.push_back(dtexcoords[0]);
-			texCoords_.push_back(dtexcoords[1]);
+			thread.join();
 		}
-		else if (line.length() >= 3 && line.substr(0, 3) == "vn ")
+	}
+
+	MeshHandle push(const std::string& filename)
+	{
+		std::unique_ptr<AsyncMesh> mesh(new AsyncMesh);
+		mesh->filename = filename;
+
+		MeshHandle handle;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (threads.empty())
+			{
+				for (int i = 0; i < num_io_threads; ++i)
+				{
+					threads.emplace_back(&IOThreadPool::run, this);
+				}
+			}
+			meshes.push_back(std::move(mesh));
+			handle = (MeshHandle)meshes.size();
+			queue.push_back(handle);
+		}
+		work_available.notify_one();
+		return handle;
+	}
+
+	LoadState state(MeshHandle handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		AsyncMesh* mesh = find(handle);
+		return mesh ? mesh->state : LoadState::Invalid;
+	}
+
+	LoadState wait(MeshHandle handle)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		load_done.wait(lock, [&]() { AsyncMesh* mesh = find(handle); return !mesh || mesh->state != LoadState::Pending; });
+		AsyncMesh* mesh = find(handle);
+		return mesh ? mesh->state : LoadState::Invalid;
+	}
+
+	const CachedMesh* get(MeshHandle handle)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		AsyncMesh* mesh = find(handle);
+		return mesh && mesh->state == LoadState::Loaded ? &mesh->mesh : nullptr;
+	}
+
+	void release(MeshHandle handle)
+	{
+		wait(handle);
+		std::unique_ptr<AsyncMesh> released;
 		{
-			std::vector<float> dnormals = split<float>(line, 1, ' ', std::atof);
-			normals_.push_back(dnormals[0]);
-			normals_.push_back(dnormals[1]);
-			normals_.push_back(dnormals[2]);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (find(handle))
+				released = std::move(meshes[handle - 1]);
 		}
-		else if (line.length() >= 2 && line.substr(0, 2) == "f ")
+		// The mapping is closed outside of the lock
+	}
+
+private:
+	// Under the lock
+	AsyncMesh* find(MeshHandle handle)
+	{
+		return handle && handle <= meshes.size() ? meshes[handle - 1].get() : nullptr;
+	}
+
+	void run()
+	{
+		for (;;)
 		{
-			std::vector<std::string> strs = splitByRegex(line, ' ');
-			assert(strs.size()-1 == 3); // We want triangles! and NOT quads!
-			for (int i = 1; i <= 3; ++i)
+			AsyncMesh* mesh;
 			{
-				std::vector<int> indices = split<int>(strs[i], 0, '/', std::atoi);
-				// Store the final values for each triangle vertex
-				vertices.push_back(vertices_[indices[0]]);
-				texCoords.push_back(texCoords_[indices[1]]);
-				normals.push_back(normals_[indices[2]]);
+				std::unique_lock<std::mutex> lock(mutex);
+				work_available.wait(lock, [this]() { return exiting || !queue.empty(); });
+				if (exiting)
+					return;
+				mesh = find(queue.front());
+				queue.pop_front();
 			}
+
+			// Nobody else touches a pending mesh, and its slot is only released once it is done
+			bool loaded = LoadMeshCached(mesh->filename, mesh->mesh);
+			if (!loaded)
+				std::cerr << "Error: Could not load mesh " << mesh->filename << std::endl;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				mesh->state = loaded ? LoadState::Loaded : LoadState::Failed;
+			}
+			load_done.notify_all();
 		}
 	}
 
-	// Interlace the data to be VTNVTNVTN...
-	std::vector<float> vertex_buffer;// (vertices.size() + texCoords.size() + normals.size());
-	for (int i = 0; i < vertices.size()/3; ++i)
+	std::mutex mutex;
+	std::condition_variable work_available;
+	std::condition_variable load_done;
+	std::vector<std::thread> threads;
+	std::deque<MeshHandle> queue;
+	std::vector<std::unique_ptr<AsyncMesh>> meshes; // Indexed by handle - 1
+	bool exiting = false;
+};
+
+static IOThreadPool io_thread_pool;
+
+MeshHandle LoadMeshAsync(const std::string& filename)
+{
+	return io_thread_pool.push(filename);
+}
+
+LoadState GetLoadState(MeshHandle handle)
+{
+	return io_thread_pool.state(handle);
+}
+
+bool IsLoaded(MeshHandle handle)
+{
+	return io_thread_pool.state(handle) == LoadState::Loaded;
+}
+
+LoadState WaitForMesh(MeshHandle handle)
+{
+	return io_thread_pool.wait(handle);
+}
+
+const CachedMesh* GetMesh(MeshHandle handle)
+{
+	return io_thread_pool.get(handle);
+}
+
+void ReleaseMesh(MeshHandle handle)
+{
+	io_thread_pool.release(handle);
+}
+
+// ------------------------
+// Meshlets
+// ------------------------
+
+static void ComputeMeshletBounds(const float* vertices, const MeshletMesh& meshlets, Meshlet& meshlet)
+{
+	auto Position = [&](uint32_t local) { return vertices + (size_t)meshlets.vertices[meshlet.vertex_offset + local] * 8; };
+
+	// Sphere around the center of the bounding box
+	float bounds_min[3], bounds_max[3];
+	for (int i = 0; i < 3; ++i)
 	{
-		// V
-		vertex_buffer.push_back(vertices[i * 3 + 0]);
-		vertex_buffer.push_back(vertices[i * 3 + 1]);
-		vertex_buffer.push_back(vertices[i * 3 + 2]);
-		// T
-		vertex_buffer.push_back(texCoords[i * 2 + 0]);
-		vertex_buffer.push_back(texCoords[i * 2 + 1]);
-		// N
-		vertex_buffer.push_back(normals[i * 3 + 0]);
-		vertex_buffer.push_back(normals[i * 3 + 1]);
-		vertex_buffer.push_back(normals[i * 3 + 2]);
+		bounds_min[i] = bounds_max[i] = Position(0)[i];
 	}
+	for (uint32_t v = 1; v < meshlet.num_vertices; ++v)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			bounds_min[i] = std::min(bounds_min[i], Position(v)[i]);
+			bounds_max[i] = std::max(bounds_max[i], Position(v)[i]);
+		}
+	}
+	float radius_squared = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		meshlet.center[i] = (bounds_min[i] + bounds_max[i]) * 0.5f;
+	}
+	for (uint32_t v = 0; v < meshlet.num_vertices; ++v)
+	{
+		const float* p = Position(v);
+		float dx = p[0] - meshlet.center[0], dy = p[1] - meshlet.center[1], dz = p[2] - meshlet.center[2];
+		radius_squared = std::max(radius_squared, dx * dx + dy * dy + dz * dz);
+	}
+	meshlet.radius = std::sqrt(radius_squared);
 
-	num_vertices = vertices.size() / 3;
-	return vertex_buffer;
+	// Normal cone : average of the face normals, opened enough to contain all of them
+	std::vector<float> normals(meshlet.num_triangles * 3);
+	float axis[3] = { 0, 0, 0 };
+	for (uint32_t t = 0; t < meshlet.num_triangles; ++t)
+	{
+		const uint8_t* triangle = &meshlets.triangles[meshlet.triangle_offset + t * 3];
+		const float* a = Position(triangle[0]);
+		const float* b = Position(triangle[1]);
+		const float* c = Position(triangle[2]);
+		float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float* normal = &normals[t * 3];
+		normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+		normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+		normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		for (int i = 0; i < 3; ++i)
+		{
+			normal[i] = length > 0 ? normal[i] / length : 0;
+			axis[i] += normal[i];
+		}
+	}
+	float axis_length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	float min_dot = 1;
+	if (axis_length > 0)
+	{
+		for (int i = 0; i < 3; ++i)
+			axis[i] /= axis_length;
+		for (uint32_t t = 0; t < meshlet.num_triangles; ++t)
+		{
+			const float* normal = &normals[t * 3];
+			min_dot = std::min(min_dot, normal[0] * axis[0] + normal[1] * axis[1] + normal[2] * axis[2]);
+		}
+	}
+	if (axis_length == 0 || min_dot <= 0)
+	{
+		// Wider than a half sphere, there is always a side facing the camera
+		meshlet.cone_axis[0] = meshlet.cone_axis[1] = meshlet.cone_axis[2] = 0;
+		meshlet.cone_cutoff = 1;
+		return;
+	}
+	for (int i = 0; i < 3; ++i)
+		meshlet.cone_axis[i] = axis[i];
+	// sin of the cone half angle : the view direction must be further than 90 degrees from every normal
+	meshlet.cone_cutoff = std::sqrt(1 - min_dot * min_dot);
 }
 
-}
\ No newline at end of file
+void BuildMeshlets(const float* vertices, int num_vertices, const void* indices, int num_indices, bool uses_16bit_indices, MeshletMesh& meshlets)
+{
+	meshlets.meshlets.clear();
+	meshlets.vertices.clear();
+	meshlets.triangles.clear();
+
+	auto Index = [&](int i) { return uses_16bit_indices ? (uint32_t)((const uint16_t*)indices)[i] : ((const uint32_t*)indices)[i]; };
+
+	// Position of every mesh vertex in the current meshlet, 0xFF when it is not in it
+	std::vector<uint8_t> local(num_vertices, 0xFF);
+	Meshlet meshlet = {};
+
+	auto Flush = [&]()
+	{
+		if (meshlet.num_triangles == 0)
+			return;
+		ComputeMeshletBounds(vertices, meshlets, meshlet);
+		meshlets.meshlets.push_back(meshlet);
+		for (uint32_t v = 0; v < meshlet.num_vertices; ++v)
+		{
+			local[meshlets.vertices[meshlet.vertex_offset + v]] = 0xFF;
+		}
+		meshlet = {};
+		meshlet.vertex_offset = (uint32_t)meshlets.vertices.size();
+		meshlet.triangle_offset = (uint32_t)meshlets.triangles.size();
+	};
+
+	for (int i = 0; i + 2 < num_indices; i += 3)
+	{
+		uint32_t triangle[3] = { Index(i), Index(i + 1), Index(i + 2) };
+		uint32_t new_vertices = 0;
+		for (int c = 0; c < 3; ++c)
+		{
+			if (local[triangle[c]] == 0xFF && (c < 1 || triangle[c] != triangle[0]) && (c < 2 || triangle[c] != triangle[1]))
+				++new_vertices;
+		}
+		if (meshlet.num_vertices + new_vertices > max_meshlet_vertices || meshlet.num_triangles + 1 > max_meshlet_triangles)
+			Flush();
+
+		for (int c = 0; c < 3; ++c)
+		{
+			uint8_t& slot = local[triangle[c]];
+			if (slot == 0xFF)
+			{
+				slot = (uint8_t)meshlet.num_vertices++;
+				meshlets.vertices.push_back(triangle[c]);
+			}
+			meshlets.triangles.push_back(slot);
+		}
+		++meshlet.num_triangles;
+	}
+	Flush();
+}
+
+}
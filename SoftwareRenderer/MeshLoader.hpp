@@ -1,9 +1,172 @@
+#ifndef MESH_LOADER_HPP
+#define MESH_LOADER_HPP
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
+#include "MappedFile.hpp"
+
 namespace MeshLoader {
 
+// A level of detail : a range of the index buffer, drawn with the same vertices as the full mesh
+struct MeshLOD
+{
+	uint32_t index_offset;
+	uint32_t num_indices;
+	float error; // How far it strays from the full mesh, in model units
+};
+
+// A mesh where every unique (v, vt, vn) combination is stored once and triangles index into it
+struct IndexedMesh
+{
+	std::vector<float> vertices; // Interleaved VTN, 8 floats per vertex
+	int num_vertices = 0;
+
+	// Only one of these is filled : 16 bit indices when every vertex fits below the 0xFFFF restart index, 32 bit otherwise
+	std::vector<uint16_t> indices16;
+	std::vector<uint32_t> indices32;
+	int num_indices = 0;
+
+	bool uses16BitIndices() const { return num_vertices < 0xFFFF; }
+	const void* indexData() const { return uses16BitIndices() ? (const void*)indices16.data() : (const void*)indices32.data(); }
+	uint32_t index(int i) const { return uses16BitIndices() ? indices16[i] : indices32[i]; }
+
+	// Filled by MeshOptimizer::GenerateLODs, finest first : level 0 is the num_indices of the full mesh,
+	// the indices of the coarser levels follow them in the index buffer
+	std::vector<MeshLOD> lods;
+};
+
+// Loads a Wavefront OBJ file as an interleaved VTN (3 + 2 + 3 floats) vertex buffer, 3 vertices per triangle.
+// Empty if the file could not be loaded, or if a face references a position it does not have
 std::vector<float> LoadMesh(const std::string& filename, int& num_vertices);
+// Same, but as an indexed mesh with duplicated vertices merged. Returns false if the file could not be loaded
+bool LoadMeshIndexed(const std::string& filename, IndexedMesh& mesh);
+
+// ------------------------
+// Streaming
+// ------------------------
+
+// Gets whole triangles of interleaved VTN vertices. The memory is reused for the next batch once this returns
+typedef std::function<void(const float* vertices, int num_vertices)> MeshBatchCallback;
+
+// Parses the file front to back, handing every batch of batch_vertices vertices (rounded down to whole triangles)
+// to the callback as soon as it is full, eg. straight to RenderPass::DrawArrays (batch_vertices <= 65535 then).
+// Only the v, vt and vn records and one batch are kept in memory, never the whole vertex buffer.
+// Stops and returns false at the first face referencing a position not read yet, once the previous batches were handed out.
+bool StreamMesh(const std::string& filename, int batch_vertices, const MeshBatchCallback& callback);
+
+// ------------------------
+// Binary mesh cache
+// ------------------------
+
+// Layout of a .srmesh file. The vertex and index blobs start at 16 byte aligned offsets
+struct MeshFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t source_size;	// Size and modification time of the OBJ it was built from,
+	int64_t  source_time;	// the cache is rebuilt when they change
+	uint32_t num_vertices;
+	uint32_t num_indices;
+	uint32_t vertex_stride;	// in floats
+	uint32_t index_size;	// 2 or 4 bytes
+	float    bounds_min[3];
+	float    bounds_max[3];
+	uint64_t vertex_offset;	// in bytes, from the start of the file
+	uint64_t index_offset;	// num_indices covers every level of detail
+	uint64_t lod_offset;	// num_lods MeshLOD
+	uint32_t num_lods;
+	uint32_t padding;
+};
+
+// An indexed mesh read straight from the memory mapping of its .srmesh file : nothing is parsed or copied
+struct CachedMesh
+{
+	MappedFile file;
+	IndexedMesh fallback; // Holds the data instead when the cache could not be written
+
+	const float* vertices = nullptr; // Interleaved VTN
+	int num_vertices = 0;
+	const void* indices = nullptr;
+	int num_indices = 0; // Of the full mesh, the levels of detail index the same buffer further on
+	bool uses_16bit_indices = true;
+	const MeshLOD* lods = nullptr;
+	int num_lods = 0;
+	float bounds_min[3] = { 0, 0, 0 };
+	float bounds_max[3] = { 0, 0, 0 };
+};
+
+// The cache of res/cube.obj is res/cube.srmesh
+std::string GetMeshCacheFilename(const std::string& filename);
+bool WriteMeshCache(const std::string& filename, const IndexedMesh& mesh);
+// Maps the cache of an OBJ file, building it first (with its levels of detail) if it is missing or out of date
+bool LoadMeshCached(const std::string& filename, CachedMesh& mesh);
+
+// ------------------------
+// Asynchronous loading
+// ------------------------
+
+enum class LoadState
+{
+	Invalid,	// Unknown or released handle
+	Pending,	// Queued or being loaded
+	Loaded,
+	Failed		// Missing or unreadable file : the handle stays valid, keep drawing the placeholder
+};
+
+// 0 is never a valid handle
+typedef uint32_t MeshHandle;
+
+// Queues LoadMeshCached on a background I/O thread and returns right away
+MeshHandle LoadMeshAsync(const std::string& filename);
+LoadState GetLoadState(MeshHandle handle);
+bool IsLoaded(MeshHandle handle);
+// Blocks until the load is done, returns Loaded or Failed (Invalid for a bad handle)
+LoadState WaitForMesh(MeshHandle handle);
+// nullptr until the mesh is loaded. Stays valid until the handle is released
+const CachedMesh* GetMesh(MeshHandle handle);
+// Waits for a pending load, then frees the mesh. Handles are not reused
+void ReleaseMesh(MeshHandle handle);
+
+// ------------------------
+// Meshlets
+// ------------------------
+
+static const int max_meshlet_vertices = 64;
+static const int max_meshlet_triangles = 124;
+
+// A small cluster of triangles, culled as a whole by RenderPass::DrawMeshlets
+struct Meshlet
+{
+	uint32_t vertex_offset;		// First entry in MeshletMesh::vertices
+	uint32_t triangle_offset;	// First entry in MeshletMesh::triangles
+	uint32_t num_vertices;
+	uint32_t num_triangles;
+
+	// Bounding sphere
+	float center[3];
+	float radius;
+
+	// Normal cone : every triangle faces away from a viewpoint eye when
+	// dot(center - eye, cone_axis) >= cone_cutoff * length(center - eye) + radius.
+	// Meshlets whose normals spread over more than a half sphere have a null axis and are never cone culled
+	float cone_axis[3];
+	float cone_cutoff;
+};
+
+struct MeshletMesh
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> vertices; // Indices of the mesh vertices used by every meshlet
+	std::vector<uint8_t> triangles; // 3 per triangle, into the meshlet's own range of vertices
+};
+
+// Splits an indexed triangle list of interleaved VTN vertices into meshlets, in index order.
+// Run MeshOptimizer first : the better the vertex locality, the fuller the meshlets
+void BuildMeshlets(const float* vertices, int num_vertices, const void* indices, int num_indices, bool uses_16bit_indices, MeshletMesh& meshlets);
+
+}
 
-}
\ No newline at end of file
+#endif
@@ -0,0 +1,576 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace MeshOptimizer {
+
+float CalculateACMR(const uint32_t* indices, size_t num_indices, int num_vertices, int fifo_size)
+{
+	if (num_indices < 3)
+		return 0;
+
+	// Simulate the FIFO : a vertex is in the cache if it entered it less than fifo_size misses ago
+	std::vector<int> entered(num_vertices, -fifo_size - 1);
+	int misses = 0;
+	for (size_t i = 0; i < num_indices; ++i)
+	{
+		uint32_t vertex = indices[i];
+		if (misses - entered[vertex] > fifo_size)
+		{
+			entered[vertex] = misses;
+			++misses;
+		}
+	}
+	return (float)misses / (float)(num_indices / 3);
+}
+
+// ------------------------
+// Tipsify
+// ------------------------
+
+// Triangles using each vertex, as a flattened adjacency list
+struct Adjacency
+{
+	std::vector<uint32_t> offsets; // num_vertices + 1
+	std::vector<uint32_t> triangles;
+};
+
+static Adjacency BuildAdjacency(const std::vector<uint32_t>& indices, int num_vertices)
+{
+	Adjacency adjacency;
+	adjacency.offsets.assign(num_vertices + 1, 0);
+	for (uint32_t vertex : indices)
+	{
+		++adjacency.offsets[vertex + 1];
+	}
+	for (int v = 0; v < num_vertices; ++v)
+	{
+		adjacency.offsets[v + 1] += adjacency.offsets[v];
+	}
+
+	adjacency.triangles.resize(indices.size());
+	std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		adjacency.triangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+	}
+	return adjacency;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, int num_vertices, std::vector<uint32_t>* clusters)
+{
+	size_t num_triangles = indices.size() / 3;
+	Adjacency adjacency = BuildAdjacency(indices, num_vertices);
+
+	// Triangles left to emit around each vertex
+	std::vector<int> live_triangles(num_vertices);
+	for (int v = 0; v < num_vertices; ++v)
+	{
+		live_triangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+	}
+	std::vector<int> cache_time(num_vertices, 0);
+	std::vector<bool> emitted(num_triangles, false);
+	std::vector<uint32_t> dead_ends;
+	std::vector<uint32_t> candidates;
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	if (clusters)
+		clusters->clear();
+
+	int time = cache_size + 1;
+	int cursor = 0;
+	int fanning = num_vertices ? 0 : -1;
+	bool new_cluster = true;
+	while (fanning >= 0)
+	{
+		if (new_cluster && clusters)
+			clusters->push_back((uint32_t)output.size());
+		new_cluster = false;
+
+		// Emit every triangle left around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; ++a)
+		{
+			uint32_t triangle = adjacency.triangles[a];
+			if (emitted[triangle])
+				continue;
+			for (int c = 0; c < 3; ++c)
+			{
+				uint32_t vertex = indices[triangle * 3 + c];
+				output.push_back(vertex);
+				dead_ends.push_back(vertex);
+				candidates.push_back(vertex);
+				--live_triangles[vertex];
+				if (time - cache_time[vertex] > cache_size)
+				{
+					cache_time[vertex] = time;
+					++time;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// Next fanning vertex : the candidate that will still be in the cache after its own triangles, and the oldest of those
+		int best = -1;
+		int best_priority = -1;
+		for (uint32_t vertex : candidates)
+		{
+			if (live_triangles[vertex] <= 0)
+				continue;
+			int priority = 0;
+			if (time - cache_time[vertex] + 2 * live_triangles[vertex] <= cache_size)
+				priority = time - cache_time[vertex];
+			if (priority > best_priority)
+			{
+				best_priority = priority;
+				best = vertex;
+			}
+		}
+		if (best >= 0)
+		{
+			fanning = best;
+			continue;
+		}
+
+		// Dead end : go back to a recently used vertex with triangles left, or else the next one in order
+		new_cluster = true;
+		fanning = -1;
+		while (!dead_ends.empty())
+		{
+			uint32_t vertex = dead_ends.back();
+			dead_ends.pop_back();
+			if (live_triangles[vertex] > 0)
+			{
+				fanning = vertex;
+				break;
+			}
+		}
+		while (fanning < 0 && cursor < num_vertices)
+		{
+			if (live_triangles[cursor] > 0)
+				fanning = cursor;
+			++cursor;
+		}
+	}
+
+	assert(output.size() == indices.size());
+	indices.swap(output);
+}
+
+// ------------------------
+// Overdraw
+// ------------------------
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters, const float* positions, int stride)
+{
+	if (clusters.size() < 2)
+		return;
+
+	auto Position = [positions, stride](uint32_t vertex) { return positions + (size_t)vertex * stride; };
+
+	// Mesh centroid
+	float mesh_center[3] = { 0, 0, 0 };
+	for (uint32_t vertex : indices)
+	{
+		for (int i = 0; i < 3; ++i)
+			mesh_center[i] += Position(vertex)[i];
+	}
+	for (int i = 0; i < 3; ++i)
+		mesh_center[i] /= (float)indices.size();
+
+	// Sort key of a cluster : how much its area weighted normal points away from the mesh center.
+	// Clusters facing outwards are likely to occlude the rest, so they are drawn first
+	struct Cluster
+	{
+		uint32_t begin, end;
+		float key;
+	};
+	std::vector<Cluster> sorted(clusters.size());
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		Cluster& cluster = sorted[c];
+		cluster.begin = clusters[c];
+		cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : (uint32_t)indices.size();
+
+		float center[3] = { 0, 0, 0 };
+		float normal[3] = { 0, 0, 0 };
+		for (uint32_t i = cluster.begin; i < cluster.end; i += 3)
+		{
+			const float* a = Position(indices[i]);
+			const float* b = Position(indices[i + 1]);
+			const float* c = Position(indices[i + 2]);
+			float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			normal[0] += ab[1] * ac[2] - ab[2] * ac[1];
+			normal[1] += ab[2] * ac[0] - ab[0] * ac[2];
+			normal[2] += ab[0] * ac[1] - ab[1] * ac[0];
+			for (int k = 0; k < 3; ++k)
+				center[k] += a[k] + b[k] + c[k];
+		}
+		float count = (float)(cluster.end - cluster.begin);
+		cluster.key = 0;
+		for (int k = 0; k < 3; ++k)
+			cluster.key += (center[k] / count - mesh_center[k]) * normal[k];
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.key > b.key; });
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	for (const Cluster& cluster : sorted)
+	{
+		output.insert(output.end(), indices.begin() + cluster.begin, indices.begin() + cluster.end);
+	}
+	indices.swap(output);
+}
+
+// ------------------------
+// Vertex fetch
+// ------------------------
+
+int OptimizeVertexFetch(std::vector<uint32_t>& indices, std::vector<float>& vertices, int num_vertices, int stride)
+{
+	std::vector<uint32_t> remap(num_vertices, ~0u);
+	std::vector<float> output;
+	output.reserve(vertices.size());
+
+	uint32_t next = 0;
+	for (uint32_t& vertex : indices)
+	{
+		if (remap[vertex] == ~0u)
+		{
+			remap[vertex] = next++;
+			output.insert(output.end(), vertices.begin() + (size_t)vertex * stride, vertices.begin() + (size_t)(vertex + 1) * stride);
+		}
+		vertex = remap[vertex];
+	}
+	vertices.swap(output);
+	return (int)next;
+}
+
+OptimizationStats OptimizeMesh(MeshLoader::IndexedMesh& mesh)
+{
+	assert(mesh.lods.empty());
+
+	std::vector<uint32_t> indices;
+	if (mesh.uses16BitIndices())
+		indices.assign(mesh.indices16.begin(), mesh.indices16.end());
+	else
+		indices = mesh.indices32;
+
+	OptimizationStats stats;
+	stats.acmr_before = CalculateACMR(indices.data(), indices.size(), mesh.num_vertices);
+
+	std::vector<uint32_t> clusters;
+	OptimizeVertexCache(indices, mesh.num_vertices, &clusters);
+	OptimizeOverdraw(indices, clusters, mesh.vertices.data(), 8);
+	mesh.num_vertices = OptimizeVertexFetch(indices, mesh.vertices, mesh.num_vertices, 8);
+
+	stats.acmr_after = CalculateACMR(indices.data(), indices.size(), mesh.num_vertices);
+	std::cout << "Mesh optimized : ACMR " << stats.acmr_before << " -> " << stats.acmr_after << std::endl;
+
+	mesh.indices16.clear();
+	mesh.indices32.clear();
+	if (mesh.uses16BitIndices())
+		mesh.indices16.assign(indices.begin(), indices.end());
+	else
+		mesh.indices32 = std::move(indices);
+	return stats;
+}
+
+// ------------------------
+// Simplification
+// ------------------------
+
+// Sum of squared distances to a set of planes, as the symmetric matrix of (x, y, z, 1)
+struct Quadric
+{
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double num_planes;
+
+	void addPlane(double nx, double ny, double nz, double d)
+	{
+		a00 += nx * nx; a01 += nx * ny; a02 += nx * nz;
+		a11 += ny * ny; a12 += ny * nz; a22 += nz * nz;
+		b0 += nx * d; b1 += ny * d; b2 += nz * d;
+		c += d * d;
+		num_planes += 1;
+	}
+	void add(const Quadric& q)
+	{
+		a00 += q.a00; a01 += q.a01; a02 += q.a02;
+		a11 += q.a11; a12 += q.a12; a22 += q.a22;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		num_planes += q.num_planes;
+	}
+	// Mean squared distance to the planes
+	double evaluate(const float* p) const
+	{
+		double x = p[0], y = p[1], z = p[2];
+		double error = a00 * x * x + a11 * y * y + a22 * z * z
+			+ 2 * (a01 * x * y + a02 * x * z + a12 * y * z)
+			+ 2 * (b0 * x + b1 * y + b2 * z) + c;
+		return error > 0 && num_planes > 0 ? error / num_planes : 0;
+	}
+};
+
+// Vertices with the exact same position share one id, so attribute seams do not split the surface
+static std::vector<uint32_t> WeldPositions(const float* vertices, int num_vertices, std::vector<int>& wedge_counts)
+{
+	struct PositionHash
+	{
+		size_t operator()(const std::array<uint32_t, 3>& p) const { return (p[0] * 73856093u) ^ (p[1] * 19349663u) ^ (p[2] * 83492791u); }
+	};
+	std::unordered_map<std::array<uint32_t, 3>, uint32_t, PositionHash> positions;
+	positions.reserve(num_vertices);
+
+	std::vector<uint32_t> weld(num_vertices);
+	wedge_counts.assign(num_vertices, 0);
+	for (int v = 0; v < num_vertices; ++v)
+	{
+		std::array<uint32_t, 3> key;
+		memcpy(key.data(), vertices + (size_t)v * 8, sizeof(float) * 3);
+		uint32_t id = positions.emplace(key, (uint32_t)v).first->second;
+		weld[v] = id;
+		++wedge_counts[id];
+	}
+	return weld;
+}
+
+float Simplify(std::vector<uint32_t>& indices, const float* vertices, int num_vertices, size_t target_indices, float max_error)
+{
+	auto Position = [vertices](uint32_t vertex) { return vertices + (size_t)vertex * 8; };
+	auto TriangleNormal = [](const float* a, const float* b, const float* c, double normal[3])
+	{
+		double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+		normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+		normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+	};
+
+	std::vector<int> wedge_counts;
+	std::vector<uint32_t> weld = WeldPositions(vertices, num_vertices, wedge_counts);
+
+	// Locked : seams, and borders (an edge with no twin going the other way)
+	std::vector<bool> locked(num_vertices, false);
+	{
+		std::unordered_set<uint64_t> edges;
+		edges.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				uint64_t a = weld[indices[i + e]], b = weld[indices[i + (e + 1) % 3]];
+				edges.insert(a << 32 | b);
+			}
+		}
+		for (uint64_t edge : edges)
+		{
+			uint64_t a = edge >> 32, b = edge & 0xFFFFFFFF;
+			if (!edges.count(b << 32 | a))
+				locked[a] = locked[b] = true;
+		}
+		for (int v = 0; v < num_vertices; ++v)
+		{
+			if (wedge_counts[weld[v]] > 1)
+				locked[weld[v]] = true;
+		}
+	}
+
+	// Plane quadrics of every triangle, accumulated on its welded corners
+	std::vector<Quadric> quadrics(num_vertices, Quadric{});
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		double normal[3];
+		const float* a = Position(indices[i]);
+		TriangleNormal(a, Position(indices[i + 1]), Position(indices[i + 2]), normal);
+		double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		if (length == 0)
+			continue;
+		for (int k = 0; k < 3; ++k)
+			normal[k] /= length;
+		double d = -(normal[0] * a[0] + normal[1] * a[1] + normal[2] * a[2]);
+		for (int c = 0; c < 3; ++c)
+			quadrics[weld[indices[i + c]]].addPlane(normal[0], normal[1], normal[2], d);
+	}
+
+	struct Collapse
+	{
+		uint32_t from, to;	// Welded ids
+		uint32_t to_vertex;	// Vertex replacing the from corners : the one used by to across the collapsed edge
+		float error;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> collapse_target(num_vertices);
+	std::vector<uint32_t> target_vertex(num_vertices);
+	std::vector<bool> touched(num_vertices);
+	double max_error_squared = (double)max_error * max_error;
+	double result_error = 0;
+
+	while (indices.size() > target_indices)
+	{
+		// Candidates : every edge, in both directions where the start is free to move
+		collapses.clear();
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int e = 0; e < 3; ++e)
+			{
+				uint32_t from_vertex = indices[i + e], to_vertex = indices[i + (e + 1) % 3];
+				uint32_t from = weld[from_vertex], to = weld[to_vertex];
+				if (locked[from] || from == to)
+					continue;
+				Quadric q = quadrics[from];
+				q.add(quadrics[to]);
+				double error = q.evaluate(Position(to));
+				if (error <= max_error_squared)
+					collapses.push_back({ from, to, to_vertex, (float)error });
+			}
+		}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		// Triangles around every welded vertex, to check the collapses do not flip any of them
+		std::vector<uint32_t> offsets(num_vertices + 1, 0);
+		for (uint32_t vertex : indices)
+			++offsets[weld[vertex] + 1];
+		for (int v = 0; v < num_vertices; ++v)
+			offsets[v + 1] += offsets[v];
+		std::vector<uint32_t> adjacency(indices.size());
+		{
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i)
+				adjacency[fill[weld[indices[i]]]++] = (uint32_t)(i / 3);
+		}
+
+		for (int v = 0; v < num_vertices; ++v)
+		{
+			collapse_target[v] = v;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+
+		// Every collapse removes about 2 triangles. Each vertex only takes part in one collapse per pass,
+		// as the costs of the others around it are out of date once it moved
+		size_t triangles_to_remove = (indices.size() - target_indices) / 3;
+		size_t removed = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (removed >= triangles_to_remove)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			bool flips = false;
+			for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1] && !flips; ++a)
+			{
+				const uint32_t* triangle = &indices[adjacency[a] * 3];
+				uint32_t w0 = weld[triangle[0]], w1 = weld[triangle[1]], w2 = weld[triangle[2]];
+				if (w0 == collapse.to || w1 == collapse.to || w2 == collapse.to)
+					continue;
+				const float* p[3] = { Position(triangle[0]), Position(triangle[1]), Position(triangle[2]) };
+				double before[3], after[3];
+				TriangleNormal(p[0], p[1], p[2], before);
+				for (int c = 0; c < 3; ++c)
+				{
+					if (weld[triangle[c]] == collapse.from)
+						p[c] = Position(collapse.to_vertex);
+				}
+				TriangleNormal(p[0], p[1], p[2], after);
+				flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0;
+			}
+			if (flips)
+				continue;
+
+			// Nothing around the collapsed edge can move anymore this pass
+			for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1]; ++a)
+			{
+				const uint32_t* triangle = &indices[adjacency[a] * 3];
+				for (int c = 0; c < 3; ++c)
+					touched[weld[triangle[c]]] = true;
+			}
+			collapse_target[collapse.from] = collapse.to;
+			target_vertex[collapse.from] = collapse.to_vertex;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			result_error = std::max(result_error, (double)collapse.error);
+			removed += 2;
+		}
+		if (removed == 0)
+			break;
+
+		// Move the corners of the collapsed vertices, and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			uint32_t triangle[3];
+			for (int c = 0; c < 3; ++c)
+			{
+				uint32_t vertex = indices[i + c];
+				uint32_t welded = weld[vertex];
+				triangle[c] = collapse_target[welded] != welded ? target_vertex[welded] : vertex;
+			}
+			if (weld[triangle[0]] == weld[triangle[1]] || weld[triangle[1]] == weld[triangle[2]] || weld[triangle[0]] == weld[triangle[2]])
+				continue;
+			indices[write++] = triangle[0];
+			indices[write++] = triangle[1];
+			indices[write++] = triangle[2];
+		}
+		indices.resize(write);
+	}
+
+	return (float)std::sqrt(result_error);
+}
+
+void GenerateLODs(MeshLoader::IndexedMesh& mesh, int max_levels)
+{
+	// Below this, a level is not worth its indices
+	static const size_t min_lod_triangles = 32;
+
+	std::vector<uint32_t> all_indices;
+	if (mesh.uses16BitIndices())
+		all_indices.assign(mesh.indices16.begin(), mesh.indices16.begin() + mesh.num_indices);
+	else
+		all_indices.assign(mesh.indices32.begin(), mesh.indices32.begin() + mesh.num_indices);
+
+	mesh.lods.clear();
+	mesh.lods.push_back({ 0, (uint32_t)mesh.num_indices, 0.0f });
+
+	size_t previous_size = mesh.num_indices;
+	for (int level = 1; level <= max_levels; ++level)
+	{
+		size_t target = (mesh.num_indices / 3 >> level) * 3;
+		if (target < min_lod_triangles * 3)
+			break;
+
+		// Every level starts over from the full mesh, so its error is measured against it and not against the previous level
+		std::vector<uint32_t> indices(all_indices.begin(), all_indices.begin() + mesh.num_indices);
+		float error = Simplify(indices, mesh.vertices.data(), mesh.num_vertices, target, std::numeric_limits<float>::max());
+		// Stuck on locked vertices
+		if (indices.empty() || indices.size() > previous_size * 9 / 10)
+			break;
+		previous_size = indices.size();
+
+		std::vector<uint32_t> level_indices = indices;
+		OptimizeVertexCache(level_indices, mesh.num_vertices);
+		mesh.lods.push_back({ (uint32_t)all_indices.size(), (uint32_t)level_indices.size(), error });
+		all_indices.insert(all_indices.end(), level_indices.begin(), level_indices.end());
+	}
+
+	if (mesh.uses16BitIndices())
+		mesh.indices16.assign(all_indices.begin(), all_indices.end());
+	else
+		mesh.indices32 = std::move(all_indices);
+}
+
+}
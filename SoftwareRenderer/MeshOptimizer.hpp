@@ -0,0 +1,52 @@
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "MeshLoader.hpp"
+
+// Post load optimizations of indexed triangle lists
+namespace MeshOptimizer {
+
+// Size of the FIFO post transform cache of RenderPass' indexed draws, the one everything here optimizes for
+static const int cache_size = 16;
+
+// Average cache miss ratio : vertices shaded per triangle with a FIFO cache (0.5 at best, 3 at worst)
+float CalculateACMR(const uint32_t* indices, size_t num_indices, int num_vertices, int fifo_size = cache_size);
+
+// Reorders the triangles for post transform cache locality (Tipsify, Sander et al. 2007).
+// clusters gets the first index of every run of triangles ending on a cache flush, for OptimizeOverdraw
+void OptimizeVertexCache(std::vector<uint32_t>& indices, int num_vertices, std::vector<uint32_t>* clusters = nullptr);
+
+// Reorders the clusters so the outward facing ones come first, which draws occluders earlier and cuts overdraw.
+// positions has stride floats per vertex
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters, const float* positions, int stride);
+
+// Renumbers the vertices in the order they are first used, and moves them accordingly, for linear vertex fetches.
+// Unused vertices are dropped. Returns the new number of vertices
+int OptimizeVertexFetch(std::vector<uint32_t>& indices, std::vector<float>& vertices, int num_vertices, int stride);
+
+struct OptimizationStats
+{
+	float acmr_before;
+	float acmr_after;
+};
+
+// Runs all of the above on a mesh, and prints the ACMR before and after. Run it before GenerateLODs
+OptimizationStats OptimizeMesh(MeshLoader::IndexedMesh& mesh);
+
+// Quadric edge collapse simplification (Garland & Heckbert 1997) of a triangle list of interleaved VTN vertices.
+// Collapses the cheapest edges until there are target_indices indices left, or the next collapse would move the surface
+// further than max_error. The vertices are not touched, the simplified triangles index the same buffer.
+// Vertices on open borders and on attribute seams (same position, different tex coord or normal) never move.
+// Returns the error of the result : the largest RMS distance from a collapsed vertex to its original planes, in model units
+float Simplify(std::vector<uint32_t>& indices, const float* vertices, int num_vertices, size_t target_indices, float max_error);
+
+// Fills mesh.lods with the full mesh and up to max_levels coarser levels, each with half the triangles of the previous one,
+// down to a few dozen triangles. Their indices are appended to the index buffer
+void GenerateLODs(MeshLoader::IndexedMesh& mesh, int max_levels = 6);
+
+}
+
+#endif
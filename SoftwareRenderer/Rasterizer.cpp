@@ -1,4 +1,3 @@
-
 #include "rasterizer.hpp"
 
 #include <algorithm>
@@ -9,11 +8,132 @@
 
 namespace Rasterizer {
 
+// Triangle color, converted once for the blend mode in use
+struct Fragment
+{
+	Color packed; // For BlendMode::None
+	float r, g, b, a; // Color in [0,255], alpha in [0,1]
+};
+
+static Fragment MakeFragment(const Vec4& color)
+{
+	Fragment fragment;
+	fragment.r = std::min(std::max(color.x, 0.0f), 1.0f) * 255.0f;
+	fragment.g = std::min(std::max(color.y, 0.0f), 1.0f) * 255.0f;
+	fragment.b = std::min(std::max(color.z, 0.0f), 1.0f) * 255.0f;
+	fragment.a = std::min(std::max(color.w, 0.0f), 1.0f);
+	fragment.packed = (int)fragment.r | ((int)fragment.g << 8) | ((int)fragment.b << 16);
+	return fragment;
+}
+
+// Writes a fragment that passed the depth test
+template <BlendMode blend_mode>
+static inline void WriteFragment(int x, int y, float z, const Fragment& fragment)
+{
+	switch (blend_mode)
+	{
+	case BlendMode::None:
+		Canvas::Draw(x, y, fragment.packed);
+		break;
+	case BlendMode::Alpha:
+		Canvas::BlendAlpha(x, y, fragment.r, fragment.g, fragment.b, fragment.a);
+		break;
+	case BlendMode::Additive:
+		Canvas::BlendAdditive(x, y, fragment.r, fragment.g, fragment.b, fragment.a);
+		break;
+	case BlendMode::Multiply:
+		Canvas::BlendMultiply(x, y, fragment.r, fragment.g, fragment.b);
+		break;
+	case BlendMode::WeightedOIT:
+		Canvas::Accumulate(x, y, fragment.r, fragment.g, fragment.b, fragment.a, z);
+		break;
+	}
+}
+
+// Render the pixels of one yline, between the min and max pixels
+template <bool shaded, bool depth_test, bool depth_write, BlendMode blend_mode>
+static inline void RasterizeLine(int pixel_y, int pixel_x_min, int pixel_x_max, float zlocation_min, float zlocation_max, int width, const Fragment& fragment, const Vec4& color, const Shading* shading)
+{
+	float zlocation = zlocation_min;
+	float delta_x_yline = pixel_x_max - pixel_x_min;
+	float delta_z_yline = zlocation_max - zlocation_min;
+	float step_z = delta_x_yline > 0 ? delta_z_yline / delta_x_yline : 0;
+
+	// Clip the line to the canvas
+	int x_start = std::max(pixel_x_min, 0);
+	int x_end = std::min(pixel_x_max, width - 1);
+	zlocation += step_z * (x_start - pixel_x_min);
+
+	// The interpolants are stepped like z, starting from the center of the pixel before the first one
+	float u_over_w = 0, v_over_w = 0, inv_w = 0;
+	if (shaded)
+	{
+		float x = x_start - 0.5f;
+		u_over_w = shading->u_over_w.origin + x * shading->u_over_w.dx + pixel_y * shading->u_over_w.dy;
+		v_over_w = shading->v_over_w.origin + x * shading->v_over_w.dx + pixel_y * shading->v_over_w.dy;
+		inv_w = shading->inv_w.origin + x * shading->inv_w.dx + pixel_y * shading->inv_w.dy;
+	}
+
+	for (int x = x_start; x <= x_end; ++x)
+	{
+		// Increment the z position by step_z
+		zlocation += step_z;
+		if (shaded)
+		{
+			u_over_w += shading->u_over_w.dx;
+			v_over_w += shading->v_over_w.dx;
+			inv_w += shading->inv_w.dx;
+		}
+
+		// These are all known at compile time, only the requested tests end up in the loop
+		if (depth_test && depth_write)
+		{
+			if (!Canvas::DrawIfNearer(x, pixel_y, zlocation))
+				continue;
+		}
+		else if (depth_test)
+		{
+			if (!Canvas::DepthTest(x, pixel_y, zlocation))
+				continue;
+		}
+		else if (depth_write)
+		{
+			Canvas::DrawDepth(x, pixel_y, zlocation);
+		}
+
+		if (shaded)
+		{
+			// Only the pixels that passed the depth test are shaded
+			FragmentInput input;
+			input.x = x;
+			input.y = pixel_y;
+			input.z = zlocation;
+			float w = fast::rcp(inv_w);
+			input.tex_coord = Vec2(u_over_w * w, v_over_w * w);
+			input.color = color;
+			Vec4 shaded_color;
+			shading->shader(input, *shading->uniforms, shaded_color);
+			WriteFragment<blend_mode>(x, pixel_y, zlocation, MakeFragment(shaded_color));
+		}
+		else
+		{
+			WriteFragment<blend_mode>(x, pixel_y, zlocation, fragment);
+		}
+	}
+}
+
 // Assuming its vertices are in 2 y-levels. (A is highest or B is lowest)
 // Counterclockwise ordering
 // And that b.x < c.x and that a.y > b.y
-void RasterizeTriangle(float ax, float ay, float az, float bx, float by, float bz, float cx, float cy, float cz, bool first_type)
+template <bool shaded, bool first_type, bool depth_test, bool depth_write, BlendMode blend_mode>
+static void RasterizeTriangle(float ax, float ay, float az, float bx, float by, float bz, float cx, float cy, float cz, const Vec4& color, const Shading* shading)
 {
+	// Shaded triangles convert the color of each pixel instead
+	Fragment fragment = shaded ? Fragment() : MakeFragment(color);
+
+	int width = Canvas::GetWidth();
+	int height = Canvas::GetHeight();
+
 	// Current position of pixel
 	int pixel_x_min = 0;
 	int pixel_x_max = 0;
@@ -74,17 +194,8 @@ void RasterizeTriangle(float ax, float ay, float az, float bx, float by, float b
 	pixel_x_max = std::floor(xlocation_max);
 
 	// Render the first point(s)
-	float zlocation = zlocation_min;
-	float delta_x_yline = pixel_x_max - pixel_x_min;
-	float delta_z_yline = zlocation_max - zlocation_min;
-	float step_z = delta_z_yline / delta_x_yline;
-	for (int x = pixel_x_min; x <= pixel_x_max; ++x)
-	{
-		zlocation += step_z;
-
-		if(Canvas::DrawIfNearer(x, pixel_y, zlocation))
-			Canvas::Draw(x, pixel_y, (int)std::floor(zlocation) << (first_type ? 8 : 0));
-	}
+	if (pixel_y >= 0 && pixel_y < height)
+		RasterizeLine<shaded, depth_test, depth_write, blend_mode>(pixel_y, pixel_x_min, pixel_x_max, zlocation_min, zlocation_max, width, fragment, color, shading);
 
 	// Iterate to find all the remaining pixels
 	while (true)
@@ -104,22 +215,47 @@ void RasterizeTriangle(float ax, float ay, float az, float bx, float by, float b
 
 		// We now have the min and max pixels for the yline of the triangle
 		// Render the pixels
-		zlocation = zlocation_min;
-		float delta_x_yline = pixel_x_max - pixel_x_min;
-		float delta_z_yline = zlocation_max - zlocation_min;
-		float step_z = delta_z_yline / delta_x_yline;
-		for (int x = pixel_x_min; x <= pixel_x_max; ++x)
-		{
-			// Increment the z position by step_z
-			zlocation += step_z;
-
-			if (Canvas::DrawIfNearer(x, pixel_y, zlocation))
-				Canvas::Draw(x, pixel_y, (int)std::floor(zlocation) << (first_type ? 8 : 0));
-		}
+		if (pixel_y >= 0 && pixel_y < height)
+			RasterizeLine<shaded, depth_test, depth_write, blend_mode>(pixel_y, pixel_x_min, pixel_x_max, zlocation_min, zlocation_max, width, fragment, color, shading);
 
 		// Check if we have passed our target
-		if (pixel_y <= by) break;
+		if (pixel_y <= by || pixel_y < 0) break;
 	}
 }
 
-}
\ No newline at end of file
+// Every combination of states, indexed by [shaded][first_type][depth_test][depth_write][blend_mode]
+template <bool shaded, bool first_type, bool depth_test, bool depth_write>
+static const RasterFunction blend_functions[(int)BlendMode::Count] = {
+	RasterizeTriangle<shaded, first_type, depth_test, depth_write, BlendMode::None>,
+	RasterizeTriangle<shaded, first_type, depth_test, depth_write, BlendMode::Alpha>,
+	RasterizeTriangle<shaded, first_type, depth_test, depth_write, BlendMode::Additive>,
+	RasterizeTriangle<shaded, first_type, depth_test, depth_write, BlendMode::Multiply>,
+	RasterizeTriangle<shaded, first_type, depth_test, depth_write, BlendMode::WeightedOIT>,
+};
+template <bool shaded>
+static const RasterFunction* const raster_functions[2][2][2] = {
+	{
+		{ blend_functions<shaded, false, false, false>, blend_functions<shaded, false, false, true> },
+		{ blend_functions<shaded, false, true,  false>, blend_functions<shaded, false, true,  true> },
+	},
+	{
+		{ blend_functions<shaded, true,  false, false>, blend_functions<shaded, true,  false, true> },
+		{ blend_functions<shaded, true,  true,  false>, blend_functions<shaded, true,  true,  true> },
+	},
+};
+
+RasterFunction GetRasterFunction(bool first_type, bool depth_test, bool depth_write, BlendMode blend_mode, bool shaded)
+{
+	if (shaded)
+		return raster_functions<true>[first_type][depth_test][depth_write][(int)blend_mode];
+	return raster_functions<false>[first_type][depth_test][depth_write][(int)blend_mode];
+}
+
+void RasterizeTriangle(float ax, float ay, float az, float bx, float by, float bz, float cx, float cy, float cz, bool first_type)
+{
+	// Depth tested and written, first type triangles in green and the others in red
+	Vec4 color = first_type ? Vec4(0, 1, 0, 1) : Vec4(1, 0, 0, 1);
+	GetRasterFunction(first_type, true, true, BlendMode::None)(ax, ay, az, bx, by, bz, cx, cy, cz, color, nullptr);
+}
+
+}
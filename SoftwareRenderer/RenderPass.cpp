@@ -1,64 +1,671 @@
-
 #include "RenderPass.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include "Canvas.hpp"
 #include "math/math.hpp"
+#include "MeshLoader.hpp"
+#include "VertexFormat.hpp"
 
 namespace RenderPass {
 
+// Default vertex shader : attribute 0 is the position, transformed by the MVP, and attribute 1 (if any) the texture coordinate
+static void DefaultVertexShader(const AttributeValues& attributes, const UniformBlock& uniforms, VertexOutput& output)
+{
+	const float* position = attributes[0];
+	output.position = mul(uniforms.getMVP(), Vec4(position[0], position[1], position[2], 1.0f));
+	output.color = Vec4(1.0f, 1.0f, 1.0f, 1.0f);
+	const float* tex_coord = attributes[1];
+	output.tex_coord = tex_coord ? Vec2(tex_coord[0], tex_coord[1]) : Vec2(0.0f, 0.0f);
+}
+
+static VertexShader vertex_shader = DefaultVertexShader;
+
+void BindVertexShader(VertexShader shader)
+{
+	vertex_shader = shader ? shader : DefaultVertexShader;
+}
+
+static FragmentShader fragment_shader = nullptr;
+
+void BindFragmentShader(FragmentShader shader)
+{
+	fragment_shader = shader;
+}
+
+static const UniformBlock default_uniforms;
+static const UniformBlock* uniforms = &default_uniforms;
+
+void BindUniformBlock(const UniformBlock* block)
+{
+	uniforms = block ? block : &default_uniforms;
+}
+
+PipelineState CreatePipelineState(const PipelineStateDesc& desc)
+{
+	PipelineState state;
+	state.desc = desc;
+	state.raster_first_type = Rasterizer::GetRasterFunction(true, desc.depth_test, desc.depth_write, desc.blend_mode);
+	state.raster_second_type = Rasterizer::GetRasterFunction(false, desc.depth_test, desc.depth_write, desc.blend_mode);
+	state.shaded_first_type = Rasterizer::GetRasterFunction(true, desc.depth_test, desc.depth_write, desc.blend_mode, true);
+	state.shaded_second_type = Rasterizer::GetRasterFunction(false, desc.depth_test, desc.depth_write, desc.blend_mode, true);
+	return state;
+}
+
+static PipelineState pipeline_state = CreatePipelineState(PipelineStateDesc());
+
+void BindPipelineState(const PipelineState& state)
+{
+	pipeline_state = state;
+}
+
+const PipelineState& GetPipelineState()
+{
+	return pipeline_state;
+}
+
+// Expands a compact attribute to floats, at most 4 : decoded is one row of VertexFetch::decoded
+static void DecodeAttribute(const VertexAttribute& attribute, const float* data, float* decoded)
+{
+	int size = std::min<int>(attribute.size, 4);
+	switch (attribute.format)
+	{
+	case AttributeFormat::UNorm16:
+	{
+		const uint16_t* values = (const uint16_t*)data;
+		for (int i = 0; i < size; ++i)
+			decoded[i] = VertexFormat::DecodeUNorm16(values[i]);
+		break;
+	}
+	case AttributeFormat::Half:
+	{
+		const uint16_t* values = (const uint16_t*)data;
+		for (int i = 0; i < size; ++i)
+			decoded[i] = VertexFormat::DecodeHalf(values[i]);
+		break;
+	}
+	case AttributeFormat::Octahedral16:
+		VertexFormat::DecodeOctahedral((const int16_t*)data, decoded);
+		break;
+	default:
+		memcpy(decoded, data, sizeof(float) * size);
+		break;
+	}
+}
+
+// Index sources for the primitive assembly
+struct ArrayIndices
+{
+	static const bool indexed = false;
+	uint32_t operator[](uint32_t i) const { return i; }
+	bool isRestart(uint32_t) const { return false; }
+};
+template <typename T>
+struct ElementIndices
+{
+	static const bool indexed = true;
+	const T* indices;
+	uint32_t operator[](uint32_t i) const { return indices[i]; }
+	// Primitive restart : the largest index of the type starts a new strip or fan
+	bool isRestart(uint32_t index) const { return index == (T)~T(0); }
+};
+
+// Post transform cache : the last shaded vertices of an indexed draw are reused instead of being shaded again.
+// A FIFO like the hardware ones, so index buffers optimized for those (see MeshOptimizer) hit it just as well
+struct VertexCache
+{
+	static const int size = 16;
+	uint32_t indices[size];
+	VertexOutput outputs[size];
+	int next = 0;
+
+	void clear()
+	{
+		std::fill(indices, indices + size, ~0u);
+		next = 0;
+	}
+	const VertexOutput* find(uint32_t index) const
+	{
+		for (int i = 0; i < size; ++i)
+		{
+			if (indices[i] == index)
+				return &outputs[i];
+		}
+		return nullptr;
+	}
+	void insert(uint32_t index, const VertexOutput& output)
+	{
+		indices[next] = index;
+		outputs[next] = output;
+		next = (next + 1) % size;
+	}
+};
+
+// Primitive assembly. shade(index, output) produces one vertex, emit(a, b, c) draws one triangle
+
+template <typename Vertex, typename Indices, typename Shade, typename Emit>
+static void AssembleList(const Indices& indices, uint32_t count, const Shade& shade, const Emit& emit)
+{
+	// Every 3 vertices make a triangle
+	Vertex outputs[3];
+	int num_outputs = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t index = indices[i];
+		if (indices.isRestart(index))
+		{
+			num_outputs = 0;
+			continue;
+		}
+
+		shade(index, outputs[num_outputs++]);
+		if (num_outputs == 3)
+		{
+			// Send the vertices and its data to a Raster Unit
+			emit(outputs[0], outputs[1], outputs[2]);
+			num_outputs = 0;
+		}
+	}
+}
+
+template <typename Vertex, typename Indices, typename Shade, typename Emit>
+static void AssembleStrip(const Indices& indices, uint32_t count, const Shade& shade, const Emit& emit)
+{
+	// Every vertex after the first two makes a triangle with the previous two, which are already shaded
+	Vertex outputs[3];
+	int num_outputs = 0;
+	bool odd = false;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t index = indices[i];
+		if (indices.isRestart(index))
+		{
+			num_outputs = 0;
+			odd = false;
+			continue;
+		}
+
+		if (num_outputs < 2)
+		{
+			shade(index, outputs[num_outputs++]);
+			continue;
+		}
+
+		shade(index, outputs[2]);
+		// Every other triangle is flipped to keep the same winding
+		if (odd)
+			emit(outputs[1], outputs[0], outputs[2]);
+		else
+			emit(outputs[0], outputs[1], outputs[2]);
+		outputs[0] = outputs[1];
+		outputs[1] = outputs[2];
+		odd = !odd;
+	}
+}
+
+template <typename Vertex, typename Indices, typename Shade, typename Emit>
+static void AssembleFan(const Indices& indices, uint32_t count, const Shade& shade, const Emit& emit)
+{
+	// Every vertex after the first two makes a triangle with the first one and the previous one
+	Vertex center, previous, current;
+	int num_outputs = 0;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t index = indices[i];
+		if (indices.isRestart(index))
+		{
+			num_outputs = 0;
+			continue;
+		}
+
+		if (num_outputs == 0)
+		{
+			shade(index, center);
+			++num_outputs;
+			continue;
+		}
+		if (num_outputs == 1)
+		{
+			shade(index, previous);
+			++num_outputs;
+			continue;
+		}
+
+		shade(index, current);
+		emit(center, previous, current);
+		previous = current;
+	}
+}
+
+template <typename Vertex, typename Indices, typename Shade, typename Emit>
+static void Assemble(Topology topology, const Indices& indices, uint32_t count, const Shade& shade, const Emit& emit)
+{
+	switch (topology)
+	{
+	case Topology::TriangleList:
+		// Leftover vertices (count not a multiple of 3) are ignored
+		AssembleList<Vertex>(indices, count, shade, emit);
+		break;
+	case Topology::TriangleStrip:
+		AssembleStrip<Vertex>(indices, count, shade, emit);
+		break;
+	case Topology::TriangleFan:
+		AssembleFan<Vertex>(indices, count, shade, emit);
+		break;
+	}
+}
+
+// A vertex after the perspective divide and the viewport transform
+struct ScreenVertex
+{
+	float x, y, z;
+	float w; // Clip space w : the vertex is behind the camera when <= 0
+	float u, v; // Texture coordinate
+};
+
+static void RenderScreenTriangle(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c, const Vec4& color);
+
+// Fetches the attributes of the vertices of a draw and runs the vertex shader on them
+class VertexFetch
+{
+public:
+	VertexFetch(const float* buffer, const float* instance_buffer, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride)
+		: buffer(buffer), instance_buffer(instance_buffer), stride(stride), instance_stride(instance_stride)
+	{
+		// Split the attributes once per draw, so the vertex loop only walks the per vertex ones
+		for (int attr = 0; attr < num_attributes; ++attr)
+		{
+			if (attributes[attr].divisor)
+				instance_attributes[num_instance_attributes++] = attributes[attr];
+			else
+				vertex_attributes[num_vertex_attributes++] = attributes[attr];
+		}
+		assert(num_instance_attributes == 0 || instance_buffer);
+		for (int attr = 0; attr < num_instance_attributes; ++attr)
+		{
+			// Instance attributes point straight into the buffer for the whole instance, they can't be decoded
+			assert(instance_attributes[attr].format == AttributeFormat::Float);
+		}
+		for (int attr = 0; attr < num_vertex_attributes; ++attr)
+		{
+			// Compact attributes are decoded to 4 floats at most, the rest of a bigger one would be dropped
+			assert(vertex_attributes[attr].format == AttributeFormat::Float || vertex_attributes[attr].size <= 4);
+		}
+
+		// Matrices are composed here, once per draw, never per vertex
+		uniforms->update();
+	}
+
+	void setInstance(uint16_t instance)
+	{
+		// Per instance attributes are only fetched once, every vertex of the instance sees the same values
+		for (int attr = 0; attr < num_instance_attributes; ++attr)
+		{
+			const VertexAttribute& attribute = instance_attributes[attr];
+			values[attribute.index] = instance_buffer + (instance / attribute.divisor) * instance_stride + attribute.offset;
+		}
+	}
+
+	void shade(uint32_t index, VertexOutput& output)
+	{
+		// Point every attribute to the current vertex
+		const float* vertex = buffer + index * stride;
+		for (int attr = 0; attr < num_vertex_attributes; ++attr)
+		{
+			const VertexAttribute& attribute = vertex_attributes[attr];
+			if (attribute.format == AttributeFormat::Float)
+			{
+				values[attribute.index] = vertex + attribute.offset;
+			}
+			else
+			{
+				DecodeAttribute(attribute, vertex + attribute.offset, decoded[attr]);
+				values[attribute.index] = decoded[attr];
+			}
+		}
+
+		vertex_shader(values, *uniforms, output);
+	}
+
+private:
+	const float* buffer;
+	const float* instance_buffer;
+	uint16_t stride;
+	uint16_t instance_stride;
+	std::array<VertexAttribute, 16> vertex_attributes;
+	std::array<VertexAttribute, 16> instance_attributes;
+	uint16_t num_vertex_attributes = 0;
+	uint16_t num_instance_attributes = 0;
+
+	AttributeValues values = {};
+	// Compact attributes are decoded here, the shader only ever reads floats
+	float decoded[16][4];
+};
+
+// Scratch of DrawTransformed, kept between draws
+static std::vector<float> batch_x, batch_y, batch_z, batch_w;
+
+// The default vertex shader only transforms positions : rather than running it vertex by vertex, every vertex the draw
+// uses goes through the batched transform, projection and viewport kernel at once, before the primitive assembly.
+// Returns false when the draw does not qualify. Texture coordinates aren't batched, so neither are draws with a fragment shader
+template <typename Indices>
+static bool DrawTransformed(const float* buffer, const Indices& indices, uint32_t count, uint16_t num_instances, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride)
+{
+	if (vertex_shader != DefaultVertexShader || fragment_shader)
+		return false;
+	const VertexAttribute* position = nullptr;
+	for (int attr = 0; attr < num_attributes; ++attr)
+	{
+		if (attributes[attr].index == 0)
+			position = &attributes[attr];
+	}
+	if (!position || position->divisor || position->format != AttributeFormat::Float || position->size < 3)
+		return false;
+
+	// Vertices used by the draw : the first count for arrays, up to the largest index for elements
+	uint32_t num_vertices = 0;
+	if (Indices::indexed)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t index = indices[i];
+			if (!indices.isRestart(index))
+				num_vertices = std::max(num_vertices, index + 1);
+		}
+	}
+	else
+	{
+		num_vertices = count;
+	}
+
+	// Structure of arrays of the positions
+	batch_x.resize(num_vertices);
+	batch_y.resize(num_vertices);
+	batch_z.resize(num_vertices);
+	batch_w.resize(num_vertices);
+	const float* vertex = buffer + position->offset;
+	for (uint32_t v = 0; v < num_vertices; ++v, vertex += stride)
+	{
+		batch_x[v] = vertex[0];
+		batch_y[v] = vertex[1];
+		batch_z[v] = vertex[2];
+	}
+
+	uniforms->update();
+	batch::TransformProject(uniforms->getMVP(), batch_x.data(), batch_y.data(), batch_z.data(), num_vertices, (float)Canvas::GetWidth(), (float)Canvas::GetHeight(),
+		batch_x.data(), batch_y.data(), batch_z.data(), batch_w.data());
+
+	auto shade = [](uint32_t index, ScreenVertex& output)
+	{
+		output = { batch_x[index], batch_y[index], batch_z[index], batch_w[index], 0.0f, 0.0f };
+	};
+	static const Vec4 white(1.0f, 1.0f, 1.0f, 1.0f);
+	auto emit = [](const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c)
+	{
+		RenderScreenTriangle(a, b, c, white);
+	};
+	// Every instance is the same, the default shader ignores instance attributes
+	for (uint16_t instance = 0; instance < num_instances; ++instance)
+	{
+		Assemble<ScreenVertex>(pipeline_state.desc.topology, indices, count, shade, emit);
+	}
+	return true;
+}
+
+template <typename Indices>
+static void Draw(const float* buffer, const Indices& indices, uint32_t count, const float* instance_buffer, uint16_t num_instances, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride)
+{
+	if (DrawTransformed(buffer, indices, count, num_instances, attributes, num_attributes, stride))
+		return;
+
+	VertexFetch fetch(buffer, instance_buffer, attributes, num_attributes, stride, instance_stride);
+	auto shade = [&fetch](uint32_t index, VertexOutput& output)
+	{
+		fetch.shade(index, output);
+	};
+
+	VertexCache cache;
+	auto shade_cached = [&](uint32_t index, VertexOutput& output)
+	{
+		if (const VertexOutput* cached = cache.find(index))
+		{
+			output = *cached;
+			return;
+		}
+		fetch.shade(index, output);
+		cache.insert(index, output);
+	};
+
+	Topology topology = pipeline_state.desc.topology;
+	for (uint16_t instance = 0; instance < num_instances; ++instance)
+	{
+		fetch.setInstance(instance);
+
+		// Only indexed draws can reference the same vertex twice
+		if (Indices::indexed)
+		{
+			cache.clear();
+			Assemble<VertexOutput>(topology, indices, count, shade_cached, RenderTriangle);
+		}
+		else
+		{
+			Assemble<VertexOutput>(topology, indices, count, shade, RenderTriangle);
+		}
+	}
+}
+
 void DrawArrays(void* buffer, uint16_t num_vertices, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride)
 {
-	// For now, let's assume we want to draw triangles
-	uint16_t vertices_processed = 0;
+	Draw((const float*)buffer, ArrayIndices(), num_vertices, nullptr, 1, attributes, num_attributes, stride, 0);
+}
+
+void DrawArraysInstanced(void* buffer, uint16_t num_vertices, void* instance_buffer, uint16_t num_instances, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride)
+{
+	Draw((const float*)buffer, ArrayIndices(), num_vertices, (const float*)instance_buffer, num_instances, attributes, num_attributes, stride, instance_stride);
+}
+
+void DrawElements(void* buffer, const void* indices, uint32_t num_indices, IndexType index_type, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride)
+{
+	DrawElementsInstanced(buffer, indices, num_indices, index_type, nullptr, 1, attributes, num_attributes, stride, 0);
+}
 
-	// This assumes that num_vertices is a multiple of 3! No easy way to check that in hardware.
-	while (vertices_processed < num_vertices)
+void DrawElementsInstanced(void* buffer, const void* indices, uint32_t num_indices, IndexType index_type, void* instance_buffer, uint16_t num_instances, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride)
+{
+	if (index_type == IndexType::UInt16)
+		Draw((const float*)buffer, ElementIndices<uint16_t>{ (const uint16_t*)indices }, num_indices, (const float*)instance_buffer, num_instances, attributes, num_attributes, stride, instance_stride);
+	else
+		Draw((const float*)buffer, ElementIndices<uint32_t>{ (const uint32_t*)indices }, num_indices, (const float*)instance_buffer, num_instances, attributes, num_attributes, stride, instance_stride);
+}
+
+// Bounding sphere against the frustum, then normal cone against the eye (only when back faces are culled)
+static bool IsMeshletVisible(const MeshLoader::Meshlet& meshlet, const Frustum& frustum, bool has_eye, const Vec3& eye)
+{
+	Vec3 center(meshlet.center[0], meshlet.center[1], meshlet.center[2]);
+	if (!frustum.intersects(Sphere(center, meshlet.radius)))
+		return false;
+
+	if (has_eye && pipeline_state.desc.cull_mode == CullMode::Back)
 	{
-		// Process 3 vertices into a triangle
-		// Send the vertices and its data to a Raster Unit
-		float ax, ay, az, bx, by, bz, cx, cy, cz;
-		ax = ay = az = bx = by = bz = cx = cy = cz = 0;
+		Vec3 to_center = center - eye;
+		Vec3 cone_axis(meshlet.cone_axis[0], meshlet.cone_axis[1], meshlet.cone_axis[2]);
+		if (to_center.dot(cone_axis) >= meshlet.cone_cutoff * to_center.length() + meshlet.radius)
+			return false;
+	}
+	return true;
+}
+
+uint32_t DrawMeshlets(void* buffer, const MeshLoader::MeshletMesh& meshlets, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride)
+{
+	VertexFetch fetch((const float*)buffer, nullptr, attributes, num_attributes, stride, 0);
+	fetch.setInstance(0);
+
+	// Culling happens in model space, against the frustum brought back through the MVP
+	// The dequantization is left out : meshlet bounds are in model space, whatever the vertex format
+	Frustum frustum(uniforms->getProjection() * uniforms->getView() * uniforms->getModel());
+	Vec3 eye;
+	bool has_eye = frustum.findEye(eye);
+
+	VertexOutput outputs[MeshLoader::max_meshlet_vertices];
+	uint32_t num_drawn = 0;
+	for (const MeshLoader::Meshlet& meshlet : meshlets.meshlets)
+	{
+		if (!IsMeshletVisible(meshlet, frustum, has_eye, eye))
+			continue;
+		++num_drawn;
 
-		// For each attribute
-		//for (int attr = 0; attr < num_attributes; ++attr)
-		//{
-		//	// Push the attribute value into an attribute buffer
-		//}
+		for (uint32_t v = 0; v < meshlet.num_vertices; ++v)
+		{
+			fetch.shade(meshlets.vertices[meshlet.vertex_offset + v], outputs[v]);
+		}
+		const uint8_t* triangles = &meshlets.triangles[meshlet.triangle_offset];
+		for (uint32_t t = 0; t < meshlet.num_triangles; ++t)
+		{
+			RenderTriangle(outputs[triangles[t * 3]], outputs[triangles[t * 3 + 1]], outputs[triangles[t * 3 + 2]]);
+		}
+	}
+	return num_drawn;
+}
 
-		// Render the three vertices (the triangle)
-		RenderTriangle(ax, ay, az, bx, by, bz, cx, cy, cz);
+int SelectLOD(const MeshLoader::MeshLOD* lods, int num_lods, const float center[3], float radius, float max_pixel_error)
+{
+	if (num_lods <= 1)
+		return 0;
 
-		vertices_processed += 3;
+	// Errors are in model units : scale them by the largest scale of the model matrix (the view is rigid)
+	const Mat4& model = uniforms->getModel();
+	float scale = 0;
+	for (int column = 0; column < 3; ++column)
+	{
+		const auto& axis = model.data[column];
+		scale = std::max(scale, std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]));
 	}
 
+	// Pixels per unit at the nearest point of the bounding sphere. Perspective projections have w = -z_view
+	const Mat4& projection = uniforms->getProjection();
+	float pixels_per_unit = projection.data[1][1] * Canvas::GetHeight() * 0.5f;
+	if (projection.data[2][3] != 0)
+	{
+		Vec4 view_center = mul(uniforms->getView() * model, Vec4(center[0], center[1], center[2], 1.0f));
+		float distance = -view_center.z - radius * scale;
+		// Inside the sphere, anything but the full mesh could show
+		if (distance <= 0)
+			return 0;
+		pixels_per_unit /= distance;
+	}
+
+	int level = 0;
+	for (int i = 1; i < num_lods; ++i)
+	{
+		if (lods[i].error * scale * std::fabs(pixels_per_unit) <= max_pixel_error)
+			level = i;
+	}
+	return level;
 }
 
-void RenderTriangle(float ax, float ay, float az, float bx, float by, float bz, float cx, float cy, float cz)
+void RenderTriangle(const VertexOutput& a, const VertexOutput& b, const VertexOutput& c)
 {
-	// Apply vertex shader code on each vertex
-	float x[3] = { ax, bx, cx };
-	float y[3] = { ay, by, cy };
-	float z[3] = { az, bz, cz };
+	const VertexOutput* vertices[3] = { &a, &b, &c };
 
-	// Vertex shader : for each vertex
-	//Mat4 matrix = Mat4::initIdentity() * Mat4::initCamera(Vec4(), Vec4(), Vec4()) * Mat4::initTranslation(Vec3(0,0,-20));
+	// Screen space positions
+	ScreenVertex screen[3];
+	float half_width = (float)Canvas::GetWidth() * 0.5f;
+	float half_height = (float)Canvas::GetHeight() * 0.5f;
 	for (int i = 0; i < 3; ++i)
 	{
-		// ----- VERTEX SHADER CODE ----- //
-		Vec4 position(x[i], y[i], z[i], 1.0);
-		//position = matrix * position;
-		// ------------------------------ //
+		// No clipping yet, drop the triangles going behind the camera
+		const Vec4& position = vertices[i]->position;
+		if (position.w <= 0)
+			return;
 
-		// Division by w
-		position.x /= position.w;
-		position.y /= position.w;
-		position.z /= position.w;
+		// Division by w, then viewport, computed like batch::TransformProject
+		float inv_w = fast::rcp<batch::projection_accuracy>(position.w);
+		screen[i].x = position.x * (inv_w * half_width) + half_width;
+		screen[i].y = position.y * (inv_w * half_height) + half_height;
+		screen[i].z = position.z * inv_w;
+		screen[i].w = position.w;
+		screen[i].u = vertices[i]->tex_coord.x;
+		screen[i].v = vertices[i]->tex_coord.y;
 	}
-	
+
+	RenderScreenTriangle(screen[0], screen[1], screen[2], a.color);
+}
+
+static void RenderScreenTriangle(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c, const Vec4& color)
+{
+	// No clipping yet, drop the triangles going behind the camera
+	if (a.w <= 0 || b.w <= 0 || c.w <= 0)
+		return;
+	float x[3] = { a.x, b.x, c.x };
+	float y[3] = { a.y, b.y, c.y };
+	float z[3] = { a.z, b.z, c.z };
+
+	// Face culling, from the winding of the triangle on screen
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (area == 0)
+		return;
+	const PipelineState& state = pipeline_state;
+	if (state.desc.cull_mode == CullMode::Back && area < 0)
+		return;
+	if (state.desc.cull_mode == CullMode::Front && area > 0)
+		return;
+
+	// Sort the vertices from top to bottom
+	int order[3] = { 0, 1, 2 };
+	std::sort(order, order + 3, [&y](int i, int j) { return y[i] > y[j]; });
+	int top = order[0], middle = order[1], bottom = order[2];
+	if (y[top] == y[bottom])
+		return;
+
 	// Detect what type of triangle we are rendering
-	bool firstType = true; // for now
+	// Split it at the middle vertex's yline into a first type triangle (flat bottom) and a second type triangle (flat top)
+	float t = (y[top] - y[middle]) / (y[top] - y[bottom]);
+	float split_x = x[top] + (x[bottom] - x[top]) * t;
+	float split_z = z[top] + (z[bottom] - z[top]) * t;
+
+	// Left and right vertices of the split yline
+	float left_x = x[middle], left_z = z[middle];
+	float right_x = split_x, right_z = split_z;
+	if (left_x > right_x)
+	{
+		std::swap(left_x, right_x);
+		std::swap(left_z, right_z);
+	}
 
-	// Rasterize the triangle
-	// TODO
+	// Without a fragment shader, the triangle is flat colored by its first vertex
+	Rasterizer::RasterFunction raster_first_type = state.raster_first_type;
+	Rasterizer::RasterFunction raster_second_type = state.raster_second_type;
+	Rasterizer::Shading shading;
+	if (fragment_shader)
+	{
+		raster_first_type = state.shaded_first_type;
+		raster_second_type = state.shaded_second_type;
+		shading.shader = fragment_shader;
+		shading.uniforms = uniforms;
+
+		// Planes through the values at the 3 vertices, from their differences along the edges from vertex 0
+		float inv_area = 1.0f / area;
+		auto gradient = [&](float a0, float a1, float a2)
+		{
+			float d1 = a1 - a0, d2 = a2 - a0;
+			Rasterizer::Gradient result;
+			result.dx = (d1 * (y[2] - y[0]) - d2 * (y[1] - y[0])) * inv_area;
+			result.dy = (d2 * (x[1] - x[0]) - d1 * (x[2] - x[0])) * inv_area;
+			result.origin = a0 - x[0] * result.dx - y[0] * result.dy;
+			return result;
+		};
+		float inv_w[3] = { 1.0f / a.w, 1.0f / b.w, 1.0f / c.w };
+		shading.u_over_w = gradient(a.u * inv_w[0], b.u * inv_w[1], c.u * inv_w[2]);
+		shading.v_over_w = gradient(a.v * inv_w[0], b.v * inv_w[1], c.v * inv_w[2]);
+		shading.inv_w = gradient(inv_w[0], inv_w[1], inv_w[2]);
+	}
+
+	if (y[top] > y[middle])
+		raster_first_type(x[top], y[top], z[top], left_x, y[middle], left_z, right_x, y[middle], right_z, color, &shading);
+	if (y[middle] > y[bottom])
+		raster_second_type(left_x, y[middle], left_z, x[bottom], y[bottom], z[bottom], right_x, y[middle], right_z, color, &shading);
 }
 
-}
\ No newline at end of file
+}
@@ -1,18 +1,128 @@
+#ifndef RENDER_PASS_HPP
+#define RENDER_PASS_HPP
 
 #include <array>
+#include <cstdint>
 
-typedef unsigned short uint16_t;
+#include "math/math.hpp"
+#include "rasterizer.hpp"
+#include "UniformBlock.hpp"
+
+namespace MeshLoader { struct MeshletMesh; struct MeshLOD; }
 
 namespace RenderPass {
 
+// How an attribute is stored in the buffer. Anything but Float is decoded to floats when the vertex is fetched
+enum class AttributeFormat : uint16_t
+{
+	Float,
+	UNorm16,		// size unsigned 16 bit integers, to [0, 1]
+	Half,			// size half floats
+	Octahedral16	// 2 SNorm16 of an octahedral encoded unit vector, to 3 floats (size must be 3)
+};
+
 struct VertexAttribute 
 {
 	uint16_t index;
-	uint16_t size; // in floats!
+	uint16_t size; // in components : floats for Float attributes. At most 4 with the compact formats
+	uint16_t offset; // in floats, from the start of the vertex (or of the instance)
+	uint16_t divisor; // 0 = per vertex attribute, N = per instance attribute advancing once every N instances
+	AttributeFormat format = AttributeFormat::Float; // See VertexFormat for the compact layouts using the others
+};
+
+// Current value of every attribute, indexed by VertexAttribute::index
+// These point directly into the vertex and instance buffers, nothing is copied
+typedef std::array<const float*, 16> AttributeValues;
+
+struct VertexOutput
+{
+	Vec4 position; // Clip space position
+	Vec4 color;
+	Vec2 tex_coord; // Interpolated for the fragment shader
 };
 
+// Vertex shader : called for each vertex with its fetched attributes and the uniforms bound to the draw
+typedef void(*VertexShader)(const AttributeValues& attributes, const UniformBlock& uniforms, VertexOutput& output);
+
+void BindVertexShader(VertexShader shader);
+
+// Fragment shader : called for each pixel that passes the depth test, see Rasterizer::FragmentInput.
+// Textures are read through Samplers (Texture.hpp) the shader can reach
+typedef Rasterizer::FragmentInput FragmentInput;
+typedef Rasterizer::FragmentShader FragmentShader;
+
+// nullptr (the default) draws triangles in the flat color of their first vertex, without any per pixel work
+void BindFragmentShader(FragmentShader shader);
+// The block must stay alive while draws use it. nullptr binds the default block (identity matrices)
+void BindUniformBlock(const UniformBlock* uniforms);
+
+enum class CullMode : uint16_t
+{
+	None,
+	Back, // Counterclockwise triangles are front facing
+	Front
+};
+
+// How vertices are assembled into triangles
+enum class Topology : uint16_t
+{
+	TriangleList,	// 0 1 2, 3 4 5, ...
+	TriangleStrip,	// 0 1 2, 2 1 3, 2 3 4, ...
+	TriangleFan		// 0 1 2, 0 2 3, 0 3 4, ...
+};
+
+enum class IndexType : uint16_t
+{
+	UInt16,
+	UInt32
+};
+
+struct PipelineStateDesc
+{
+	bool depth_test = true;
+	bool depth_write = true;
+	CullMode cull_mode = CullMode::Back;
+	BlendMode blend_mode = BlendMode::None; // WeightedOIT usually goes with depth_write off
+	Topology topology = Topology::TriangleList;
+};
+
+// Immutable once created : every state combination resolves to its specialized raster functions up front,
+// so a draw picks its raster loop once instead of testing states per pixel
+struct PipelineState
+{
+	PipelineStateDesc desc;
+	Rasterizer::RasterFunction raster_first_type;
+	Rasterizer::RasterFunction raster_second_type;
+	// The same, running the bound fragment shader
+	Rasterizer::RasterFunction shaded_first_type;
+	Rasterizer::RasterFunction shaded_second_type;
+};
+
+PipelineState CreatePipelineState(const PipelineStateDesc& desc);
+void BindPipelineState(const PipelineState& state);
+const PipelineState& GetPipelineState();
+
+// Strides are in floats, like the attribute sizes
 void DrawArrays(void* buffer, uint16_t num_vertices, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes,  uint16_t stride);
+// Draws num_instances copies of the same vertices. Attributes with a divisor are read from instance_buffer
+void DrawArraysInstanced(void* buffer, uint16_t num_vertices, void* instance_buffer, uint16_t num_instances, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride);
+// Indexed draws. The largest index of the index type (0xFFFF or 0xFFFFFFFF) restarts the strip or fan
+void DrawElements(void* buffer, const void* indices, uint32_t num_indices, IndexType index_type, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride);
+void DrawElementsInstanced(void* buffer, const void* indices, uint32_t num_indices, IndexType index_type, void* instance_buffer, uint16_t num_instances, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride, uint16_t instance_stride);
+
+// Draws the meshlets of MeshLoader::BuildMeshlets as triangle lists (whatever the bound topology).
+// Meshlets outside of the frustum of the MVP, or whose normal cone faces away from the camera, are skipped before
+// any of their vertices is shaded, and the others shade each of their vertices once.
+// Their bounds are in the space they were built in, which must be the model space of the bound uniforms.
+// Returns the number of meshlets drawn
+uint32_t DrawMeshlets(void* buffer, const MeshLoader::MeshletMesh& meshlets, const std::array<VertexAttribute, 16>& attributes, uint16_t num_attributes, uint16_t stride);
+
+// Picks the coarsest level of detail whose error, projected with the bound uniforms, stays under max_pixel_error.
+// center and radius are the bounding sphere of the mesh, in model space. Returns an index into lods
+int SelectLOD(const MeshLoader::MeshLOD* lods, int num_lods, const float center[3], float radius, float max_pixel_error = 1.0f);
+
+void RenderTriangle(const VertexOutput& a, const VertexOutput& b, const VertexOutput& c);
 
-void RenderTriangle(float ax, float ay, float az, float bx, float by, float bz, float cx, float cy, float cz);
+}
 
-}
\ No newline at end of file
+#endif
@@ -0,0 +1,160 @@
+#include "Texture.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// ------------------------
+// Texture
+// ------------------------
+
+bool Texture::load(const std::string& filename)
+{
+	int image_width, image_height, channels;
+	unsigned char* pixels = stbi_load(filename.c_str(), &image_width, &image_height, &channels, STBI_rgb_alpha);
+	if (pixels == nullptr)
+	{
+		std::cerr << "Error: Could not load texture " << filename << " : " << stbi_failure_reason() << std::endl;
+		*this = Texture();
+		return false;
+	}
+
+	// RGBA bytes are the packed texels on little endian machines
+	bool created = create(image_width, image_height, (const uint32_t*)pixels);
+	stbi_image_free(pixels);
+	if (!created)
+		std::cerr << "Error: Texture " << filename << " is " << image_width << "x" << image_height << ", textures are at most " << max_size << " texels wide and high" << std::endl;
+	return created;
+}
+
+bool Texture::create(int width, int height, const uint32_t* texels)
+{
+	if (width <= 0 || height <= 0 || width > max_size || height > max_size)
+	{
+		*this = Texture();
+		return false;
+	}
+
+	const int texels_per_line = sizeof(CacheLine) / sizeof(uint32_t);
+	this->width = width;
+	this->height = height;
+	pitch = (width + texels_per_line - 1) / texels_per_line * texels_per_line;
+	lines.assign((size_t)pitch / texels_per_line * height, CacheLine());
+
+	// Flipped, the first row of the image is the top one
+	uint32_t* rows = lines[0].texels;
+	for (int y = 0; y < height; ++y)
+	{
+		memcpy(rows + (size_t)y * pitch, texels + (size_t)(height - 1 - y) * width, width * sizeof(uint32_t));
+	}
+	return true;
+}
+
+// ------------------------
+// Sampler
+// ------------------------
+
+// Texture coordinate to a 16.16 fixed point texel coordinate. Wrapped coordinates only keep their fraction and clamped ones
+// stay in [0, 1] before the scale, so that the fixed point value can't overflow however far the coordinate is.
+// The comparisons are written so that NaN fails them and ends up at a bound, never in a float to int conversion
+template <AddressMode mode>
+static inline int32_t ToFixed(float u, float scale, int32_t bias)
+{
+	if (mode == AddressMode::Wrap)
+	{
+		// Past 2^23 floats have no fraction left, clamping there keeps the truncation below in range.
+		// Truncation instead of std::floor, which is a library call on SSE2
+		const float max_integer = 8388608.0f;
+		u = u > -max_integer ? u : -max_integer;
+		u = u < max_integer ? u : max_integer;
+		u -= (float)(int32_t)u;
+		u = u < 0 ? u + 1.0f : u;
+	}
+	else
+	{
+		u = u > 0.0f ? u : 0.0f;
+		u = u < 1.0f ? u : 1.0f;
+	}
+	return (int32_t)(u * scale) + bias;
+}
+
+// Integer texel coordinate to a texel of the texture. Coordinates are at most one texel out of it
+template <AddressMode mode>
+static inline int Address(int x, int size)
+{
+	if (mode == AddressMode::Wrap)
+		return x < 0 ? x + size : (x >= size ? x - size : x);
+	return std::min(std::max(x, 0), size - 1);
+}
+
+// a * (256 - weight) + b * weight, with weight in [0, 256). The red and blue bytes are computed at once, then the green
+// and alpha ones, each in their own 16 bits where the products fit
+static inline uint32_t Lerp(uint32_t a, uint32_t b, uint32_t weight)
+{
+	uint32_t rb = (a & 0x00FF00FF) * (256 - weight) + (b & 0x00FF00FF) * weight;
+	uint32_t ga = ((a >> 8) & 0x00FF00FF) * (256 - weight) + ((b >> 8) & 0x00FF00FF) * weight;
+	return ((rb >> 8) & 0x00FF00FF) | (ga & 0xFF00FF00);
+}
+
+template <Filter filter, AddressMode address_u, AddressMode address_v>
+uint32_t Sampler::sampleTexture(const Sampler& sampler, float u, float v)
+{
+	int32_t fixed_u = ToFixed<address_u>(u, sampler.scale_u, sampler.bias);
+	int32_t fixed_v = ToFixed<address_v>(v, sampler.scale_v, sampler.bias);
+	int x = fixed_u >> 16;
+	int y = fixed_v >> 16;
+
+	if (filter == Filter::Nearest)
+	{
+		x = Address<address_u>(x, sampler.width);
+		y = Address<address_v>(y, sampler.height);
+		return sampler.texels[y * sampler.pitch + x];
+	}
+
+	// The top 8 bits of the fractions weight the 4 texels
+	uint32_t weight_u = (fixed_u >> 8) & 0xFF;
+	uint32_t weight_v = (fixed_v >> 8) & 0xFF;
+	int x0 = Address<address_u>(x, sampler.width);
+	int x1 = Address<address_u>(x + 1, sampler.width);
+	const uint32_t* row0 = sampler.texels + Address<address_v>(y, sampler.height) * sampler.pitch;
+	const uint32_t* row1 = sampler.texels + Address<address_v>(y + 1, sampler.height) * sampler.pitch;
+	uint32_t bottom = Lerp(row0[x0], row0[x1], weight_u);
+	uint32_t top = Lerp(row1[x0], row1[x1], weight_u);
+	return Lerp(bottom, top, weight_v);
+}
+
+uint32_t Sampler::sampleEmpty(const Sampler&, float, float)
+{
+	return 0xFF000000;
+}
+
+Sampler::Sampler(const Texture& texture, const SamplerDesc& desc)
+	: desc(desc)
+{
+	if (texture.isEmpty())
+		return;
+
+	texels = texture.getTexels();
+	pitch = texture.getPitch();
+	width = texture.getWidth();
+	height = texture.getHeight();
+	scale_u = width * 65536.0f;
+	scale_v = height * 65536.0f;
+	bias = desc.filter == Filter::Bilinear ? -0x8000 : 0;
+
+	// Every combination, indexed by [filter][address_u][address_v]
+	static const SampleFunction functions[2][2][2] = {
+		{
+			{ sampleTexture<Filter::Nearest, AddressMode::Wrap, AddressMode::Wrap>, sampleTexture<Filter::Nearest, AddressMode::Wrap, AddressMode::Clamp> },
+			{ sampleTexture<Filter::Nearest, AddressMode::Clamp, AddressMode::Wrap>, sampleTexture<Filter::Nearest, AddressMode::Clamp, AddressMode::Clamp> },
+		},
+		{
+			{ sampleTexture<Filter::Bilinear, AddressMode::Wrap, AddressMode::Wrap>, sampleTexture<Filter::Bilinear, AddressMode::Wrap, AddressMode::Clamp> },
+			{ sampleTexture<Filter::Bilinear, AddressMode::Clamp, AddressMode::Wrap>, sampleTexture<Filter::Bilinear, AddressMode::Clamp, AddressMode::Clamp> },
+		},
+	};
+	function = functions[(int)desc.filter][(int)desc.address_u][(int)desc.address_v];
+}
@@ -0,0 +1,108 @@
+#ifndef TEXTURE_HPP
+#define TEXTURE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "math/math.hpp"
+
+// 8 bit RGBA images. Texels are packed like the canvas colors, R | G << 8 | B << 16, with A << 24 on top.
+// Every row starts on a 64 byte boundary (the pitch is rounded up to 16 texels), and rows are stored bottom to top :
+// v = 0 is the bottom of the image, like the texture coordinates of OBJ files.
+class Texture {
+public:
+	// Samplers address texels in 16.16 fixed point, which leaves 15 bits for the integer part
+	static const int max_size = 32767;
+
+	// Any format stb_image reads, converted to RGBA. Returns false and leaves the texture empty if the file could not be loaded
+	bool load(const std::string& filename);
+	// Copies width * height RGBA texels, top row first like in image files.
+	// Returns false and leaves the texture empty unless both sizes are in [1, max_size]
+	bool create(int width, int height, const uint32_t* texels);
+
+	bool isEmpty() const { return lines.empty(); }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	// Distance between two rows, in texels
+	int getPitch() const { return pitch; }
+	// Row 0 is the bottom row
+	const uint32_t* getTexels() const { return lines.empty() ? nullptr : lines[0].texels; }
+
+private:
+	struct alignas(64) CacheLine
+	{
+		uint32_t texels[16];
+	};
+	std::vector<CacheLine> lines;
+	int width = 0;
+	int height = 0;
+	int pitch = 0;
+};
+
+enum class Filter : uint16_t
+{
+	Nearest,
+	Bilinear	// The 4 nearest texels, weighted with 8 bit fractions
+};
+
+// What happens to texture coordinates outside of [0, 1]
+enum class AddressMode : uint16_t
+{
+	Wrap,	// The texture repeats
+	Clamp	// The edge texels stretch out
+};
+
+struct SamplerDesc
+{
+	Filter filter = Filter::Bilinear;
+	AddressMode address_u = AddressMode::Wrap;
+	AddressMode address_v = AddressMode::Wrap;
+};
+
+// Reads a texture from fragment shaders.
+// Immutable once created, like pipeline states : the filter and address modes resolve to a specialized sample function,
+// and coordinates go to texels through scales precomputed for the texture, in 16.16 fixed point.
+// Samplers point to the texels of their texture : create them once it is loaded, and keep it alive while they are used.
+class Sampler {
+public:
+	Sampler() {}
+	Sampler(const Texture& texture, const SamplerDesc& desc);
+
+	// Packed RGBA texel, or the filtered value of texels. Opaque black for a sampler of an empty texture
+	uint32_t fetch(float u, float v) const
+	{
+		return function(*this, u, v);
+	}
+	// RGBA in [0,1], like the vertex colors
+	Vec4 sample(float u, float v) const
+	{
+		uint32_t texel = fetch(u, v);
+		const float scale = 1.0f / 255.0f;
+		return Vec4((texel & 0xFF) * scale, ((texel >> 8) & 0xFF) * scale, ((texel >> 16) & 0xFF) * scale, (texel >> 24) * scale);
+	}
+
+	const SamplerDesc& getDesc() const { return desc; }
+
+private:
+	typedef uint32_t(*SampleFunction)(const Sampler& sampler, float u, float v);
+
+	template <Filter filter, AddressMode address_u, AddressMode address_v>
+	static uint32_t sampleTexture(const Sampler& sampler, float u, float v);
+	static uint32_t sampleEmpty(const Sampler&, float, float);
+
+	SamplerDesc desc;
+	SampleFunction function = sampleEmpty;
+
+	const uint32_t* texels = nullptr;
+	int pitch = 0;
+	int width = 0;
+	int height = 0;
+	// Texture coordinates times these are 16.16 fixed point texel coordinates
+	float scale_u = 0;
+	float scale_v = 0;
+	// Added to the fixed point coordinates : minus half a texel for bilinear filtering, so that texel centers get full weight
+	int32_t bias = 0;
+};
+
+#endif
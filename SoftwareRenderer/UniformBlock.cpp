@@ -0,0 +1,64 @@
+#include "UniformBlock.hpp"
+
+UniformBlock::UniformBlock()
+	: model(Mat4::initIdentity()), view(Mat4::initIdentity()), projection(Mat4::initIdentity()), dequantization(Mat4::initIdentity()), dirty(true)
+{
+}
+
+void UniformBlock::setModel(const Mat4& model)
+{
+	this->model = model;
+	dirty = true;
+}
+
+void UniformBlock::setView(const Mat4& view)
+{
+	this->view = view;
+	dirty = true;
+}
+
+void UniformBlock::setProjection(const Mat4& projection)
+{
+	this->projection = projection;
+	dirty = true;
+}
+
+void UniformBlock::setDequantization(const Mat4& dequantization)
+{
+	this->dequantization = dequantization;
+	dirty = true;
+}
+
+void UniformBlock::update() const
+{
+	if (!dirty)
+		return;
+
+	mvp = projection * view * model * dequantization;
+
+	// Normal matrix : cofactors of the upper 3x3 of the model matrix, divided by its determinant.
+	// The dequantization stays out of it, its non uniform scale would skew the normals
+	// (matrices are stored as data[column][row])
+	auto m = [this](int row, int column) { return model.data[column][row]; };
+	float cofactors[3][3];
+	for (int row = 0; row < 3; ++row)
+	{
+		for (int column = 0; column < 3; ++column)
+		{
+			int r0 = (row + 1) % 3, r1 = (row + 2) % 3;
+			int c0 = (column + 1) % 3, c1 = (column + 2) % 3;
+			cofactors[row][column] = m(r0, c0) * m(r1, c1) - m(r0, c1) * m(r1, c0);
+		}
+	}
+	float determinant = m(0, 0) * cofactors[0][0] + m(0, 1) * cofactors[0][1] + m(0, 2) * cofactors[0][2];
+	float inv_determinant = determinant != 0 ? 1.0f / determinant : 0.0f;
+	for (int row = 0; row < 3; ++row)
+	{
+		for (int column = 0; column < 3; ++column)
+		{
+			normal_matrix.data[column][row] = cofactors[row][column] * inv_determinant;
+		}
+	}
+
+	dirty = false;
+}
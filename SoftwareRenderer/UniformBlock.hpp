@@ -0,0 +1,55 @@
+#ifndef UNIFORM_BLOCK_HPP
+#define UNIFORM_BLOCK_HPP
+
+#include "math/math.hpp"
+
+// Per draw constants handed to the vertex shader.
+// The model, view and projection matrices are composed once into a cached MVP (and normal matrix),
+// which is only recomputed when one of them changes.
+// The dequantization transform takes the positions stored in the vertex buffer to model space (see
+// VertexFormat::GetDequantizationMatrix). It is part of the MVP but not of the normal matrix : normals are stored in model space
+class UniformBlock {
+public:
+	UniformBlock();
+
+	void setModel(const Mat4& model);
+	void setView(const Mat4& view);
+	void setProjection(const Mat4& projection);
+	// Identity by default
+	void setDequantization(const Mat4& dequantization);
+
+	const Mat4& getModel() const { return model; }
+	const Mat4& getView() const { return view; }
+	const Mat4& getProjection() const { return projection; }
+	const Mat4& getDequantization() const { return dequantization; }
+
+	// Recompute the cached matrices if any input changed. RenderPass calls this once per draw
+	void update() const;
+
+	// projection * view * model * dequantization
+	const Mat4& getMVP() const
+	{
+		if (dirty)
+			update();
+		return mvp;
+	}
+	// Inverse transpose of the model matrix, for world space normals
+	const Mat3& getNormalMatrix() const
+	{
+		if (dirty)
+			update();
+		return normal_matrix;
+	}
+
+private:
+	Mat4 model;
+	Mat4 view;
+	Mat4 projection;
+	Mat4 dequantization;
+
+	mutable bool dirty;
+	mutable Mat4 mvp;
+	mutable Mat3 normal_matrix;
+};
+
+#endif
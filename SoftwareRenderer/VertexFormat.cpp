@@ -0,0 +1,52 @@
+#include "VertexFormat.hpp"
+
+#include <cstddef>
+
+namespace VertexFormat {
+
+std::vector<QuantizedVertex> QuantizeVertices(const float* vertices, int num_vertices, const float bounds_min[3], const float bounds_max[3])
+{
+	float scale[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		float extent = bounds_max[i] - bounds_min[i];
+		scale[i] = extent > 0 ? 1.0f / extent : 0;
+	}
+
+	std::vector<QuantizedVertex> quantized(num_vertices);
+	for (int v = 0; v < num_vertices; ++v)
+	{
+		const float* vertex = vertices + v * 8;
+		QuantizedVertex& output = quantized[v];
+		for (int i = 0; i < 3; ++i)
+		{
+			output.position[i] = EncodeUNorm16((vertex[i] - bounds_min[i]) * scale[i]);
+		}
+		output.padding = 0;
+		output.tex_coord[0] = EncodeHalf(vertex[3]);
+		output.tex_coord[1] = EncodeHalf(vertex[4]);
+		EncodeOctahedral(vertex + 5, output.normal);
+	}
+	return quantized;
+}
+
+Mat4 GetDequantizationMatrix(const float bounds_min[3], const float bounds_max[3])
+{
+	Mat4 matrix = Mat4::initIdentity();
+	for (int i = 0; i < 3; ++i)
+	{
+		matrix.data[i][i] = bounds_max[i] - bounds_min[i];
+		matrix.data[3][i] = bounds_min[i];
+	}
+	return matrix;
+}
+
+uint16_t GetQuantizedAttributes(std::array<RenderPass::VertexAttribute, 16>& attributes)
+{
+	attributes[0] = { 0, 3, offsetof(QuantizedVertex, position) / sizeof(float), 0, RenderPass::AttributeFormat::UNorm16 };
+	attributes[1] = { 1, 2, offsetof(QuantizedVertex, tex_coord) / sizeof(float), 0, RenderPass::AttributeFormat::Half };
+	attributes[2] = { 2, 3, offsetof(QuantizedVertex, normal) / sizeof(float), 0, RenderPass::AttributeFormat::Octahedral16 };
+	return 3;
+}
+
+}
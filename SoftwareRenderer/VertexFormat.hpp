@@ -0,0 +1,165 @@
+#ifndef VERTEX_FORMAT_HPP
+#define VERTEX_FORMAT_HPP
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "math/math.hpp"
+#include "RenderPass.hpp"
+
+// Compact vertex layouts, and the encodings RenderPass decodes on fetch
+namespace VertexFormat {
+
+// 16 bytes instead of the 32 of an interleaved VTN vertex
+struct QuantizedVertex
+{
+	uint16_t position[3];	// UNorm16, relative to the bounds of the mesh
+	uint16_t padding;		// Keeps the next attributes on 4 byte boundaries, as attribute offsets are counted in floats
+	int16_t normal[2];		// Octahedral, SNorm16
+	uint16_t tex_coord[2];	// Half floats
+};
+static_assert(sizeof(QuantizedVertex) == 16, "QuantizedVertex must stay 16 bytes");
+
+// Stride of QuantizedVertex, in floats like every stride
+static const uint16_t quantized_stride = sizeof(QuantizedVertex) / sizeof(float);
+
+// ------------------------
+// Encodings
+// ------------------------
+
+inline uint16_t EncodeUNorm16(float value)
+{
+	value = value < 0 ? 0 : (value > 1 ? 1 : value);
+	return (uint16_t)(value * 65535.0f + 0.5f);
+}
+inline float DecodeUNorm16(uint16_t value)
+{
+	return value * (1.0f / 65535.0f);
+}
+
+inline int16_t EncodeSNorm16(float value)
+{
+	value = value < -1 ? -1 : (value > 1 ? 1 : value);
+	return (int16_t)std::lround(value * 32767.0f);
+}
+inline float DecodeSNorm16(int16_t value)
+{
+	float decoded = value * (1.0f / 32767.0f);
+	return decoded < -1 ? -1 : decoded;
+}
+
+// IEEE half float, rounded to nearest. Values too small for a half become 0, too large become infinite
+inline uint16_t EncodeHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (((bits >> 23) & 0xFF) == 0xFF) // Inf and NaN
+		return sign | 0x7C00 | (mantissa ? 0x200 : 0);
+	if (exponent >= 31)
+		return sign | 0x7C00;
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+			return sign;
+		// Denormal half
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1)
+			++half;
+		return sign | (uint16_t)half;
+	}
+
+	uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000) // Round, a carry into the exponent is still correct
+		++half;
+	return sign | (uint16_t)half;
+}
+inline float DecodeHalf(uint16_t value)
+{
+	uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+
+	uint32_t bits;
+	if (exponent == 0x1F)
+	{
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else if (exponent == 0)
+	{
+		// Zero or denormal
+		float decoded = mantissa * (1.0f / 16777216.0f);
+		return sign ? -decoded : decoded;
+	}
+	else
+	{
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+	float decoded;
+	memcpy(&decoded, &bits, sizeof(decoded));
+	return decoded;
+}
+
+// Unit vector to 2 SNorm16 : projected on the octahedron, whose lower half is folded over the upper one
+inline void EncodeOctahedral(const float normal[3], int16_t encoded[2])
+{
+	float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+	if (length == 0)
+	{
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+	float x = normal[0] / length;
+	float y = normal[1] / length;
+	if (normal[2] < 0)
+	{
+		float folded_x = (1.0f - std::fabs(y)) * (x >= 0 ? 1.0f : -1.0f);
+		float folded_y = (1.0f - std::fabs(x)) * (y >= 0 ? 1.0f : -1.0f);
+		x = folded_x;
+		y = folded_y;
+	}
+	encoded[0] = EncodeSNorm16(x);
+	encoded[1] = EncodeSNorm16(y);
+}
+inline void DecodeOctahedral(const int16_t encoded[2], float normal[3])
+{
+	float x = DecodeSNorm16(encoded[0]);
+	float y = DecodeSNorm16(encoded[1]);
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+	float t = z < 0 ? -z : 0;
+	x += x >= 0 ? -t : t;
+	y += y >= 0 ? -t : t;
+
+	float length = std::sqrt(x * x + y * y + z * z);
+	normal[0] = x / length;
+	normal[1] = y / length;
+	normal[2] = z / length;
+}
+
+// ------------------------
+// Quantized meshes
+// ------------------------
+
+// Packs interleaved VTN vertices, with positions relative to the given bounds (see MeshLoader::CachedMesh)
+std::vector<QuantizedVertex> QuantizeVertices(const float* vertices, int num_vertices, const float bounds_min[3], const float bounds_max[3]);
+
+// Positions decode to [0, 1] : this scale and translation takes them back to the bounds.
+// Bind it with UniformBlock::setDequantization, not folded into the model matrix : the normal matrix must not see its scale,
+// which is not uniform and would skew the normals (they are stored in model space, unscaled)
+Mat4 GetDequantizationMatrix(const float bounds_min[3], const float bounds_max[3]);
+
+// Attributes of QuantizedVertex, with the same indices as the VTN layout : 0 position, 1 tex coord, 2 normal.
+// Returns the number of attributes, draw with quantized_stride
+uint16_t GetQuantizedAttributes(std::array<RenderPass::VertexAttribute, 16>& attributes);
+
+}
+
+#endif
@@ -7,6 +7,8 @@
 #include "Canvas.hpp"
 #include "Rasterizer.hpp"
 #include "MeshLoader.hpp"
+#include "RenderPass.hpp"
+#include "Texture.hpp"
 
 // ----------------
 // Globals
@@ -14,6 +16,13 @@
 
 static GLFWwindow* window;
 
+static MeshLoader::MeshHandle mesh_handle;
+static bool mesh_drawn = false;
+static UniformBlock mesh_uniforms;
+static constexpr Mat4 mesh_model = Mat4::initScale(Vec3(0.5f, 0.5f, 0.5f));
+static Texture mesh_texture;
+static Sampler mesh_sampler;
+
 #define WIDTH 800
 #define HEIGHT 800
 
@@ -25,6 +34,12 @@ void Input();
 void Update();
 void Render();
 
+// Textures the mesh with its interpolated texture coordinates
+static void TexturedFragmentShader(const RenderPass::FragmentInput& input, const UniformBlock&, Vec4& color)
+{
+	color = mesh_sampler.sample(input.tex_coord.x, input.tex_coord.y);
+}
+
 void main(int argc, char* argv[])
 {
 	std::cout << "Software Renderer" << std::endl;
@@ -53,12 +68,12 @@ void main(int argc, char* argv[])
 	Rasterizer::RasterizeTriangle(400, 400, 50, 200, 200, 255, 600, 400, 255, false);
 	Canvas::Update();
 
-	// Load the 3D bunny
-	int num_vertices = 0;
-	std::vector<float> buffer = MeshLoader::LoadMesh("res/cube.obj", num_vertices);
-	assert(num_vertices > 0);
-
-	// Render the mesh
+	// Load the 3D bunny in the background, the triangles above stay as a placeholder until it is ready
+	mesh_handle = MeshLoader::LoadMeshAsync("res/cube.obj");
+	mesh_uniforms.setModel(mesh_model);
+	// Without its texture, the mesh is drawn flat
+	if (mesh_texture.load("res/test.png"))
+		mesh_sampler = Sampler(mesh_texture, SamplerDesc());
 
 	// 60 FPS loop
 	auto current_time = std::chrono::high_resolution_clock::now();
@@ -98,7 +113,29 @@ void Input()
 
 void Update()
 {
-
+	// Poll the load, and render the mesh as soon as it is there. A failed load keeps the placeholder
+	if (mesh_drawn)
+		return;
+	MeshLoader::LoadState state = MeshLoader::GetLoadState(mesh_handle);
+	if (state == MeshLoader::LoadState::Pending)
+		return;
+	mesh_drawn = true;
+	if (state != MeshLoader::LoadState::Loaded)
+		return;
+
+	const MeshLoader::CachedMesh* mesh = MeshLoader::GetMesh(mesh_handle);
+	std::array<RenderPass::VertexAttribute, 16> attributes = {};
+	attributes[0] = { 0, 3, 0, 0 };
+	attributes[1] = { 1, 2, 3, 0 };
+	RenderPass::IndexType index_type = mesh->uses_16bit_indices ? RenderPass::IndexType::UInt16 : RenderPass::IndexType::UInt32;
+
+	Canvas::Clear(0);
+	RenderPass::BindUniformBlock(&mesh_uniforms);
+	RenderPass::BindFragmentShader(mesh_texture.isEmpty() ? nullptr : TexturedFragmentShader);
+	RenderPass::DrawElements((void*)mesh->vertices, mesh->indices, mesh->num_indices, index_type, attributes, 2, 8);
+	RenderPass::BindFragmentShader(nullptr);
+	RenderPass::BindUniformBlock(nullptr);
+	Canvas::Update();
 }
 
 void Render()
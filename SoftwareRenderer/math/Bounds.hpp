@@ -0,0 +1,242 @@
+
+#ifndef BOUNDS_HPP
+#define BOUNDS_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "Matrix.hpp"
+#include "Vector.hpp"
+#include "simd.hpp"
+
+// Bounding volumes, and the frustum tests that cull them before any of their vertices are processed
+
+// The points p with normal . p + distance = 0. Points in front of the plane (on the side of the normal) have positive distances
+struct Plane
+{
+	Vec3 normal;
+	float distance;
+
+	constexpr Plane() : normal(0.0f, 0.0f, 0.0f), distance(0.0f) {}
+	constexpr Plane(const Vec3& normal, float distance) : normal(normal), distance(distance) {}
+
+	// Signed distance, in units of the length of the normal
+	constexpr float distanceTo(const Vec3& point) const
+	{
+		return normal.dot(point) + distance;
+	}
+	// Scales the equation so that the normal has unit length, and distances are in world units
+	void normalize()
+	{
+		float length = normal.length();
+		if (length > 0)
+		{
+			normal = Vec3(normal[0] / length, normal[1] / length, normal[2] / length);
+			distance /= length;
+		}
+	}
+};
+
+struct Sphere
+{
+	Vec3 center;
+	float radius;
+
+	constexpr Sphere() : center(0.0f, 0.0f, 0.0f), radius(0.0f) {}
+	constexpr Sphere(const Vec3& center, float radius) : center(center), radius(radius) {}
+};
+
+// Axis aligned box, from its lowest to its highest corner
+struct AABB
+{
+	Vec3 lower;
+	Vec3 upper;
+
+	constexpr AABB() : lower(0.0f, 0.0f, 0.0f), upper(0.0f, 0.0f, 0.0f) {}
+	constexpr AABB(const Vec3& lower, const Vec3& upper) : lower(lower), upper(upper) {}
+
+	constexpr Vec3 getCenter() const
+	{
+		return Vec3((lower[0] + upper[0]) * 0.5f, (lower[1] + upper[1]) * 0.5f, (lower[2] + upper[2]) * 0.5f);
+	}
+	// Half of the size along each axis
+	constexpr Vec3 getExtents() const
+	{
+		return Vec3((upper[0] - lower[0]) * 0.5f, (upper[1] - lower[1]) * 0.5f, (upper[2] - lower[2]) * 0.5f);
+	}
+};
+
+// The 6 planes of a view volume, normals pointing inside.
+// The tests are conservative : a bound is culled only when it is completely behind one of the planes, so bounds near the
+// corners of the frustum can pass while being outside of it.
+// The batch tests take bounds as structure of arrays (one array per component, like batch.hpp), and test 4 of them against
+// all planes with each instruction. The array versions go through 8 bounds per iteration, as two registers of 4.
+class Frustum {
+public:
+	// Left, right, bottom, top, near, far
+	Plane planes[6];
+
+	Frustum() {}
+	// Planes of the clip volume -w <= x, y, z <= w, in the space the matrix transforms from : world space for a view
+	// projection matrix, model space for a model view projection
+	explicit Frustum(const Mat4f& matrix)
+	{
+		// data is [column][row], plane 2k is row 3 + row k, plane 2k + 1 is row 3 - row k
+		const auto& d = matrix.data;
+		for (int plane = 0; plane < 6; ++plane)
+		{
+			int row = plane / 2;
+			float sign = plane % 2 ? -1.0f : 1.0f;
+			planes[plane] = Plane(Vec3(d[0][3] + sign * d[0][row], d[1][3] + sign * d[1][row], d[2][3] + sign * d[2][row]), d[3][3] + sign * d[3][row]);
+			planes[plane].normalize();
+		}
+	}
+
+	// The eye is where the side planes of a perspective frustum meet. Returns false for parallel projections
+	bool findEye(Vec3& eye) const
+	{
+		const Vec3& n0 = planes[0].normal;
+		const Vec3& n1 = planes[1].normal;
+		const Vec3& n2 = planes[2].normal;
+		Vec3 c12 = cross(n1, n2), c20 = cross(n2, n0), c01 = cross(n0, n1);
+		float determinant = n0.dot(c12);
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+		for (int i = 0; i < 3; ++i)
+		{
+			eye[i] = -(planes[0].distance * c12[i] + planes[1].distance * c20[i] + planes[2].distance * c01[i]) / determinant;
+		}
+		return true;
+	}
+
+	// ------------------------
+	// One bound
+	// ------------------------
+	bool intersects(const Sphere& sphere) const
+	{
+		for (const Plane& plane : planes)
+		{
+			if (plane.distanceTo(sphere.center) + sphere.radius < 0)
+				return false;
+		}
+		return true;
+	}
+	bool intersects(const AABB& box) const
+	{
+		return intersectsBox(box.getCenter(), box.getExtents());
+	}
+
+	// ------------------------
+	// 4 bounds, bit i of the result set when bound i is at least partly inside.
+	// Registers are taken by reference : 32 bit MSVC passes at most 3 of them by value
+	// ------------------------
+	int intersectsSpheres4(const simd::float4& x, const simd::float4& y, const simd::float4& z, const simd::float4& radius) const
+	{
+		// The smallest distance to any plane : negative when outside of at least one of them
+		simd::float4 nearest = simd::splat(INFINITY);
+		for (const Plane& plane : planes)
+		{
+			simd::float4 distance = simd::mul(x, simd::splat(plane.normal[0]));
+			distance = simd::madd(y, simd::splat(plane.normal[1]), distance);
+			distance = simd::madd(z, simd::splat(plane.normal[2]), distance);
+			distance = simd::add(distance, simd::splat(plane.distance));
+			nearest = simd::minimum(nearest, simd::add(distance, radius));
+		}
+		return ~simd::negativeMask(nearest) & 0xF;
+	}
+	int intersectsAABBs4(const simd::float4& center_x, const simd::float4& center_y, const simd::float4& center_z, const simd::float4& extent_x, const simd::float4& extent_y, const simd::float4& extent_z) const
+	{
+		simd::float4 nearest = simd::splat(INFINITY);
+		for (const Plane& plane : planes)
+		{
+			simd::float4 distance = simd::mul(center_x, simd::splat(plane.normal[0]));
+			distance = simd::madd(center_y, simd::splat(plane.normal[1]), distance);
+			distance = simd::madd(center_z, simd::splat(plane.normal[2]), distance);
+			distance = simd::add(distance, simd::splat(plane.distance));
+			simd::float4 reach = simd::mul(extent_x, simd::splat(std::fabs(plane.normal[0])));
+			reach = simd::madd(extent_y, simd::splat(std::fabs(plane.normal[1])), reach);
+			reach = simd::madd(extent_z, simd::splat(std::fabs(plane.normal[2])), reach);
+			nearest = simd::minimum(nearest, simd::add(distance, reach));
+		}
+		return ~simd::negativeMask(nearest) & 0xF;
+	}
+
+	// ------------------------
+	// n bounds, visible[i] set to 1 when bound i is at least partly inside and to 0 otherwise. Returns the number of visible bounds
+	// ------------------------
+	size_t cullSpheres(const float* x, const float* y, const float* z, const float* radius, size_t n, uint8_t* visible) const
+	{
+		auto test = [&](size_t i)
+		{
+			return intersectsSpheres4(simd::load(x + i), simd::load(y + i), simd::load(z + i), simd::load(radius + i));
+		};
+		auto single = [&](size_t i)
+		{
+			return intersects(Sphere(Vec3(x[i], y[i], z[i]), radius[i]));
+		};
+		return cull(n, visible, test, single);
+	}
+	size_t cullAABBs(const float* center_x, const float* center_y, const float* center_z, const float* extent_x, const float* extent_y, const float* extent_z, size_t n, uint8_t* visible) const
+	{
+		auto test = [&](size_t i)
+		{
+			return intersectsAABBs4(simd::load(center_x + i), simd::load(center_y + i), simd::load(center_z + i),
+				simd::load(extent_x + i), simd::load(extent_y + i), simd::load(extent_z + i));
+		};
+		auto single = [&](size_t i)
+		{
+			return intersectsBox(Vec3(center_x[i], center_y[i], center_z[i]), Vec3(extent_x[i], extent_y[i], extent_z[i]));
+		};
+		return cull(n, visible, test, single);
+	}
+
+private:
+	// Boxes are tested from their center and extents, computed the same way as in intersectsAABBs4
+	bool intersectsBox(const Vec3& center, const Vec3& extents) const
+	{
+		for (const Plane& plane : planes)
+		{
+			// Distance of the corner furthest along the normal
+			float reach = extents[0] * std::fabs(plane.normal[0]) + extents[1] * std::fabs(plane.normal[1]) + extents[2] * std::fabs(plane.normal[2]);
+			if (plane.distanceTo(center) + reach < 0)
+				return false;
+		}
+		return true;
+	}
+
+	template <typename Test4, typename Test>
+	static size_t cull(size_t n, uint8_t* visible, const Test4& test, const Test& single)
+	{
+		size_t num_visible = 0;
+		auto write = [&](size_t i, int mask)
+		{
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				visible[i + lane] = (mask >> lane) & 1;
+				num_visible += visible[i + lane];
+			}
+		};
+
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			// Two independent registers, so that their latencies overlap
+			int low = test(i), high = test(i + 4);
+			write(i, low);
+			write(i + 4, high);
+		}
+		for (; i + 4 <= n; i += 4)
+		{
+			write(i, test(i));
+		}
+		for (; i < n; ++i)
+		{
+			visible[i] = single(i) ? 1 : 0;
+			num_visible += visible[i];
+		}
+		return num_visible;
+	}
+};
+
+#endif
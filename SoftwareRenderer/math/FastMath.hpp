@@ -0,0 +1,266 @@
+
+#ifndef FAST_MATH_HPP
+#define FAST_MATH_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "simd.hpp"
+
+// Approximations of 1 / x, 1 / sqrt(x), sin and cos, for floats and for registers of 4 floats.
+// Every function takes the accuracy it needs as a template argument, so each call site picks its own trade off :
+//   Full   : the exact operations of <cmath>
+//   Medium : about 22 bits, 1 or 2 float ulps off (sin and cos are within 2e-7)
+//   Low    : about 12 bits, a relative error under 4e-4 (sin and cos are within 4e-4)
+// The float and the register versions of rcp and rsqrt compute the exact same operations, so they give the same results
+// (except at Full accuracy on 32 bit ARM, which has no vector division).
+namespace fast {
+
+enum class Accuracy
+{
+	Full,
+	Medium,
+	Low
+};
+
+// ------------------------
+// Hardware estimates, refined below by Newton steps : as many as needed to reach the accuracy of the tier
+// ------------------------
+
+#if defined(MATH_SIMD_SSE)
+
+// rcpps and rsqrtps are good to 12 bits
+inline float rcpEstimate(float x) { return _mm_cvtss_f32(_mm_rcp_ss(_mm_set_ss(x))); }
+inline simd::float4 rcpEstimate(simd::float4 x) { return _mm_rcp_ps(x); }
+inline float rsqrtEstimate(float x) { return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x))); }
+inline simd::float4 rsqrtEstimate(simd::float4 x) { return _mm_rsqrt_ps(x); }
+const int low_steps = 0, medium_steps = 1;
+
+#elif defined(MATH_SIMD_NEON)
+
+// vrecpe and vrsqrte are good to 8 bits
+inline float rcpEstimate(float x) { return vget_lane_f32(vrecpe_f32(vdup_n_f32(x)), 0); }
+inline simd::float4 rcpEstimate(simd::float4 x) { return vrecpeq_f32(x); }
+inline float rsqrtEstimate(float x) { return vget_lane_f32(vrsqrte_f32(vdup_n_f32(x)), 0); }
+inline simd::float4 rsqrtEstimate(simd::float4 x) { return vrsqrteq_f32(x); }
+const int low_steps = 1, medium_steps = 2;
+
+#else
+
+// Integer tricks on the bits of the float, good to 4 bits
+inline float rcpEstimate(float x)
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(float));
+	bits = 0x7EF311C3u - bits;
+	memcpy(&x, &bits, sizeof(float));
+	return x;
+}
+inline float rsqrtEstimate(float x)
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(float));
+	bits = 0x5F375A86u - (bits >> 1);
+	memcpy(&x, &bits, sizeof(float));
+	return x;
+}
+inline simd::float4 rcpEstimate(simd::float4 x)
+{
+	for (int i = 0; i < 4; ++i) x.v[i] = rcpEstimate(x.v[i]);
+	return x;
+}
+inline simd::float4 rsqrtEstimate(simd::float4 x)
+{
+	for (int i = 0; i < 4; ++i) x.v[i] = rsqrtEstimate(x.v[i]);
+	return x;
+}
+const int low_steps = 2, medium_steps = 3;
+
+#endif
+
+// Lanes of a register through the <cmath> functions, for the Full tier
+template <typename Function>
+inline simd::float4 perLane(simd::float4 x, Function function)
+{
+	alignas(16) float lanes[4];
+	simd::store(lanes, x);
+	for (int i = 0; i < 4; ++i)
+		lanes[i] = function(lanes[i]);
+	return simd::load(lanes);
+}
+
+// ------------------------
+// Reciprocal
+// ------------------------
+
+// 1 / x. The approximations give NaN for 0 and infinity
+template <Accuracy accuracy = Accuracy::Medium>
+inline float rcp(float x)
+{
+	if constexpr (accuracy == Accuracy::Full)
+		return 1.0f / x;
+
+	float r = rcpEstimate(x);
+	for (int i = 0; i < (accuracy == Accuracy::Low ? low_steps : medium_steps); ++i)
+		r = r * (2.0f - x * r);
+	return r;
+}
+template <Accuracy accuracy = Accuracy::Medium>
+inline simd::float4 rcp(simd::float4 x)
+{
+	if constexpr (accuracy == Accuracy::Full)
+		return simd::div(simd::splat(1.0f), x);
+
+	simd::float4 r = rcpEstimate(x);
+	for (int i = 0; i < (accuracy == Accuracy::Low ? low_steps : medium_steps); ++i)
+		r = simd::mul(r, simd::sub(simd::splat(2.0f), simd::mul(x, r)));
+	return r;
+}
+
+// ------------------------
+// Reciprocal square root
+// ------------------------
+
+// 1 / sqrt(x). The approximations give NaN for 0 and infinity
+template <Accuracy accuracy = Accuracy::Medium>
+inline float rsqrt(float x)
+{
+	if constexpr (accuracy == Accuracy::Full)
+		return 1.0f / std::sqrt(x);
+
+	float r = rsqrtEstimate(x);
+	for (int i = 0; i < (accuracy == Accuracy::Low ? low_steps : medium_steps); ++i)
+		r = r * (1.5f - (0.5f * x) * (r * r));
+	return r;
+}
+template <Accuracy accuracy = Accuracy::Medium>
+inline simd::float4 rsqrt(simd::float4 x)
+{
+	if constexpr (accuracy == Accuracy::Full)
+		return perLane(x, [](float lane) { return 1.0f / std::sqrt(lane); });
+
+	simd::float4 r = rsqrtEstimate(x);
+	for (int i = 0; i < (accuracy == Accuracy::Low ? low_steps : medium_steps); ++i)
+		r = simd::mul(r, simd::sub(simd::splat(1.5f), simd::mul(simd::mul(simd::splat(0.5f), x), simd::mul(r, r))));
+	return r;
+}
+
+// ------------------------
+// Sine and cosine
+// ------------------------
+
+// x = j * pi / 2 + r, with r in [-pi / 4, pi / 4]. pi / 2 is split in 3 floats (Cody and Waite), the first ones with few enough bits
+// for j * part to be exact. Accurate while |x| < 1e5, beyond that use the Full tier
+const float two_over_pi = 0.636619772367581343f;
+const float half_pi_1 = 1.5703125f;
+const float half_pi_2 = 4.837512969970703125e-4f;
+const float half_pi_3 = 7.549789954891882e-8f;
+
+// Polynomials of sin and cos on [-pi / 4, pi / 4] : Taylor series for Low, minimax (from Cephes) for Medium
+template <Accuracy accuracy>
+inline float sinPolynomial(float r, float r2)
+{
+	if constexpr (accuracy == Accuracy::Low)
+		return r + r * r2 * (-1.6666667e-1f + r2 * 8.3333333e-3f);
+	return r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+}
+template <Accuracy accuracy>
+inline float cosPolynomial(float r2)
+{
+	if constexpr (accuracy == Accuracy::Low)
+		return 1.0f + r2 * (-0.5f + r2 * 4.1666667e-2f);
+	return 1.0f + r2 * (-0.5f + r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f)));
+}
+template <Accuracy accuracy>
+inline simd::float4 sinPolynomial(simd::float4 r, simd::float4 r2)
+{
+	simd::float4 p;
+	if constexpr (accuracy == Accuracy::Low)
+		p = simd::madd(r2, simd::splat(8.3333333e-3f), simd::splat(-1.6666667e-1f));
+	else
+	{
+		p = simd::madd(r2, simd::splat(-1.9515295891e-4f), simd::splat(8.3321608736e-3f));
+		p = simd::madd(r2, p, simd::splat(-1.6666654611e-1f));
+	}
+	return simd::add(r, simd::mul(simd::mul(r, r2), p));
+}
+template <Accuracy accuracy>
+inline simd::float4 cosPolynomial(simd::float4 r2)
+{
+	simd::float4 p;
+	if constexpr (accuracy == Accuracy::Low)
+		p = simd::madd(r2, simd::splat(4.1666667e-2f), simd::splat(-0.5f));
+	else
+	{
+		p = simd::madd(r2, simd::splat(2.443315711809948e-5f), simd::splat(-1.388731625493765e-3f));
+		p = simd::madd(r2, p, simd::splat(4.166664568298827e-2f));
+		p = simd::madd(r2, p, simd::splat(-0.5f));
+	}
+	return simd::madd(r2, p, simd::splat(1.0f));
+}
+
+template <Accuracy accuracy = Accuracy::Medium>
+inline void sincos(float x, float& s, float& c)
+{
+	if constexpr (accuracy == Accuracy::Full)
+	{
+		s = std::sin(x);
+		c = std::cos(x);
+		return;
+	}
+
+	// Nearest integer, like the register version below (std::floor is a library call on SSE2)
+	float j = (x * two_over_pi + 12582912.0f) - 12582912.0f;
+	float r = ((x - j * half_pi_1) - j * half_pi_2) - j * half_pi_3;
+	float r2 = r * r;
+	float sin_r = sinPolynomial<accuracy>(r, r2);
+	float cos_r = cosPolynomial<accuracy>(r2);
+
+	// Quarter turns : (sin, cos) becomes (cos, -sin), (-sin, -cos), then (-cos, sin)
+	int quadrant = (int)j & 3;
+	float sin_q = quadrant & 1 ? cos_r : sin_r;
+	float cos_q = quadrant & 1 ? sin_r : cos_r;
+	s = quadrant & 2 ? -sin_q : sin_q;
+	c = (quadrant + 1) & 2 ? -cos_q : cos_q;
+}
+template <Accuracy accuracy = Accuracy::Medium>
+inline void sincos(simd::float4 x, simd::float4& s, simd::float4& c)
+{
+	if constexpr (accuracy == Accuracy::Full)
+	{
+		s = perLane(x, [](float lane) { return std::sin(lane); });
+		c = perLane(x, [](float lane) { return std::cos(lane); });
+		return;
+	}
+
+	// Rounding to the nearest integer with float operations only : adding 1.5 * 2^23 leaves no bits for the fraction
+	const simd::float4 round = simd::splat(12582912.0f);
+	auto nearest = [&round](simd::float4 a) { return simd::sub(simd::add(a, round), round); };
+
+	simd::float4 j = nearest(simd::mul(x, simd::splat(two_over_pi)));
+	simd::float4 r = simd::sub(x, simd::mul(j, simd::splat(half_pi_1)));
+	r = simd::sub(r, simd::mul(j, simd::splat(half_pi_2)));
+	r = simd::sub(r, simd::mul(j, simd::splat(half_pi_3)));
+	simd::float4 r2 = simd::mul(r, r);
+	simd::float4 sin_r = sinPolynomial<accuracy>(r, r2);
+	simd::float4 cos_r = cosPolynomial<accuracy>(r2);
+
+	// The same quarter turns as above, without branches. As floats that are 0 or 1 :
+	// quadrant = j mod 4, half = quadrant >= 2, swap = quadrant is odd
+	const simd::float4 one = simd::splat(1.0f), two = simd::splat(2.0f);
+	simd::float4 quadrant = simd::sub(j, simd::mul(simd::splat(4.0f), nearest(simd::sub(simd::mul(j, simd::splat(0.25f)), simd::splat(0.375f)))));
+	simd::float4 half = nearest(simd::sub(simd::mul(quadrant, simd::splat(0.5f)), simd::splat(0.25f)));
+	simd::float4 swap = simd::sub(quadrant, simd::mul(two, half));
+	simd::float4 keep = simd::sub(one, swap);
+	// sin is negative in the second half, cos when exactly one of half and swap is set
+	simd::float4 sin_sign = simd::sub(one, simd::mul(two, half));
+	simd::float4 cos_sign = simd::sub(one, simd::mul(two, simd::sub(simd::add(swap, half), simd::mul(two, simd::mul(swap, half)))));
+	// One of the two products is 0 and the other exact, so this selects without rounding
+	s = simd::mul(sin_sign, simd::madd(cos_r, swap, simd::mul(sin_r, keep)));
+	c = simd::mul(cos_sign, simd::madd(sin_r, swap, simd::mul(cos_r, keep)));
+}
+
+}
+
+#endif
@@ -3,9 +3,11 @@
 #define MATRIX_HPP
 
 #include "Vector.hpp"
+#include "simd.hpp"
 
 #include <array>
 #include <cassert>
+#include <type_traits>
 
 #undef min
 #undef max
@@ -15,20 +17,25 @@
 template <typename T, int dim_x, int dim_y>
 class MatrixBase {
 public:
-	std::array<std::array<T, dim_y>, dim_x> data;
+	// Float 4x4 matrices go through the SIMD kernels of simd.hpp, except in constant expressions
+	static constexpr bool simd_matrix = std::is_same<T, float>::value && dim_x == 4 && dim_y == 4;
+
+	// Columns of 4 are 16 byte aligned, like Vector<T, 4>
+	alignas(dim_y == 4 ? 16 : alignof(T)) std::array<std::array<T, dim_y>, dim_x> data;
+
+	// Zero initialized, so that matrices can be built in constant expressions
+	constexpr MatrixBase() : data() {}
 
 	// Common matrix constructors
 	// Zero constructor
-	inline static MatrixBase<T, dim_x, dim_y> initNull()
+	inline static constexpr MatrixBase<T, dim_x, dim_y> initNull()
 	{
-		MatrixBase<T, dim_x, dim_y> matrix;
-		memset(&matrix.data, 0, sizeof(T)*dim_x*dim_y);
-		return matrix;
+		return MatrixBase<T, dim_x, dim_y>();
 	}
 	// Identity constructor
-	inline static MatrixBase<T, dim_x, dim_y> initIdentity()
+	inline static constexpr MatrixBase<T, dim_x, dim_y> initIdentity()
 	{
-		MatrixBase<T, dim_x, dim_y> matrix = std::move(initNull());
+		MatrixBase<T, dim_x, dim_y> matrix;
 		for (int i = 0; i < std::min(dim_x, dim_y); ++i)
 		{
 			matrix.data[i][i] = 1;
@@ -37,9 +44,9 @@ public:
 	}
 	// Scale constructor
 	template <int dim>
-	inline static MatrixBase<T, dim_x, dim_y> initScale(const Vector<T, dim>& scales)
+	inline static constexpr MatrixBase<T, dim_x, dim_y> initScale(const Vector<T, dim>& scales)
 	{
-		MatrixBase<T, dim_x, dim_y> matrix = std::move(initIdentity());
+		MatrixBase<T, dim_x, dim_y> matrix = initIdentity();
 		for (int i = 0; i < std::min(std::min(dim_x, dim_y), dim); ++i)
 		{
 			matrix.data[i][i] = scales[i];
@@ -48,9 +55,9 @@ public:
 	}
 	// Translation constructor
 	template <int dim>
-	inline static MatrixBase<T, dim_x, dim_y> initTranslation(const Vector<T, dim>& translations)
+	inline static constexpr MatrixBase<T, dim_x, dim_y> initTranslation(const Vector<T, dim>& translations)
 	{
-		MatrixBase<T, dim_x, dim_y> matrix = std::move(initIdentity());
+		MatrixBase<T, dim_x, dim_y> matrix = initIdentity();
 		for (int i = 0; i < std::min(dim_y, dim); ++i)
 		{
 			matrix.data[dim_x - 1][i] = translations[i];
@@ -98,13 +105,23 @@ public:
 	}
 
 	// Access functions
-	Vector<T, dim_y> getColumn(unsigned i)
+	constexpr Vector<T, dim_y> getColumn(unsigned i) const
 	{
-		return Vector<T, dim_y>(data[i]);
+		std::array<T, dim_y> column = data[i];
+		return column;
 	}
-	Vector<T, dim_x> getRow(unsigned i)
+	constexpr Vector<T, dim_x> getRow(unsigned i) const
 	{
-		std::array<T, dim_x> row;
+		if constexpr (simd_matrix)
+		{
+			if (!simd::IsConstantEvaluated())
+			{
+				Vector<T, 4> row;
+				simd::row4(&data[0][0], i, &row.data[0]);
+				return row;
+			}
+		}
+		std::array<T, dim_x> row = {};
 		for (int c = 0; c < dim_x; ++c) {
 			row[c] = data[c][i];
 		}
@@ -113,12 +130,15 @@ public:
 
 	// Helper functions to set column and row vectors
 	template <int dim>
-	void setColumn(unsigned i, const Vector<T, dim>& column)
+	constexpr void setColumn(unsigned i, const Vector<T, dim>& column)
 	{
-		memcpy(&data[i], column, sizeof(T)*std::min(dim, dim_y));
+		for (int r = 0; r < std::min(dim, dim_y); ++r)
+		{
+			data[i][r] = column[r];
+		}
 	}
 	template <int dim>
-	void setRow(unsigned i, const Vector<T, dim>& row)
+	constexpr void setRow(unsigned i, const Vector<T, dim>& row)
 	{
 		for (int c = 0; c < std::min(dim, dim_x); ++c)
 		{
@@ -127,67 +147,127 @@ public:
 	}
 
 	// Matrix multiplication (Same size matrices)
-	inline friend MatrixBase<T, dim_x, dim_y> mul(const MatrixBase<T, dim_x, dim_y>& a, const MatrixBase<T, dim_x, dim_y>& b)
+	inline constexpr friend MatrixBase<T, dim_x, dim_y> mul(const MatrixBase<T, dim_x, dim_y>& a, const MatrixBase<T, dim_x, dim_y>& b)
 	{
-		MatrixBase<T, dim_x, dim_y> result;
-		for (int i = 0; i < dim_y; ++i)
-		{
-			for (int j = 0; j < dim_x; ++j)
-			{
-				result.data[i][j] = dot(getRow(i), b.getColumn(j));
-			}
-		}
-		return result;
+		return multiply(a, b);
 	}
-	MatrixBase<T, dim_x, dim_y> mul(const MatrixBase<T, dim_x, dim_y>& b)
+	constexpr MatrixBase<T, dim_x, dim_y> mul(const MatrixBase<T, dim_x, dim_y>& b) const
 	{
-		return mul(this, b);
+		return multiply(*this, b);
 	}
 	// Matrix - matrix mul operators
-	MatrixBase<T, dim_x, dim_y> operator*(const MatrixBase<T, dim_x, dim_y>& b)
+	constexpr MatrixBase<T, dim_x, dim_y> operator*(const MatrixBase<T, dim_x, dim_y>& b) const
 	{
-		return mul(this, b);
+		return multiply(*this, b);
 	}
-	void operator*=(const MatrixBase<T, dim_x, dim_y>& b)
+	constexpr void operator*=(const MatrixBase<T, dim_x, dim_y>& b)
 	{
-		this = std::move(mul(this, b));
+		*this = multiply(*this, b);
 	}
 
 	// Matrix vector multiplication
 	template <int dim>
-	inline friend Vector<T, dim> mul(const MatrixBase<T, dim_x, dim_y>& m, const Vector<T, dim>& v)
+	inline constexpr friend Vector<T, dim> mul(const MatrixBase<T, dim_x, dim_y>& m, const Vector<T, dim>& v)
+	{
+		return transform(m, v);
+	}
+	template <int dim>
+	constexpr Vector<T, dim> mul(const Vector<T, dim>& v) const
+	{
+		return transform(*this, v);
+	}
+	// Matrix - vector mul operator
+	template <int dim>
+	constexpr Vector<T, dim> operator*(const Vector<T, dim>& v) const
+	{
+		return transform(*this, v);
+	}
+
+	// The same products, always computed by the scalar loops. For constant expressions on compilers where
+	// simd::IsConstantEvaluated can't tell, like the v141 toolset of the project : mul and * reach the kernels there
+	inline constexpr friend MatrixBase<T, dim_x, dim_y> constexprMul(const MatrixBase<T, dim_x, dim_y>& a, const MatrixBase<T, dim_x, dim_y>& b)
+	{
+		return multiplyScalar(a, b);
+	}
+	template <int dim>
+	inline constexpr friend Vector<T, dim> constexprMul(const MatrixBase<T, dim_x, dim_y>& m, const Vector<T, dim>& v)
+	{
+		return transformScalar(m, v);
+	}
+
+private:
+	// The member mul functions hide the friend ones inside the class, so both forward to these
+	static constexpr MatrixBase<T, dim_x, dim_y> multiply(const MatrixBase<T, dim_x, dim_y>& a, const MatrixBase<T, dim_x, dim_y>& b)
+	{
+		MatrixBase<T, dim_x, dim_y> result;
+		if constexpr (simd_matrix)
+		{
+			if (!simd::IsConstantEvaluated())
+			{
+				// Column by column, no row is ever gathered
+				simd::multiply4x4(&a.data[0][0], &b.data[0][0], &result.data[0][0]);
+				return result;
+			}
+		}
+		return multiplyScalar(a, b);
+	}
+	// Rows are read straight from data, getRow would take the kernels too
+	static constexpr MatrixBase<T, dim_x, dim_y> multiplyScalar(const MatrixBase<T, dim_x, dim_y>& a, const MatrixBase<T, dim_x, dim_y>& b)
+	{
+		MatrixBase<T, dim_x, dim_y> result;
+		for (int i = 0; i < dim_y; ++i)
+		{
+			for (int j = 0; j < dim_x; ++j)
+			{
+				// dot product between the row of a and the column of b
+				T dot = 0;
+				for (int k = 0; k < dim_x; ++k)
+				{
+					dot += a.data[k][i] * b.data[j][k];
+				}
+				result.data[j][i] = dot;
+			}
+		}
+		return result;
+	}
+	template <int dim>
+	static constexpr Vector<T, dim> transform(const MatrixBase<T, dim_x, dim_y>& m, const Vector<T, dim>& v)
 	{
 		// For now, we only support matrix-vector multiplication for vectors that have atleast a dimension = or > than the number of rows of the matrix.
 		// This is because, it is not clear if a vector with less components should or should not include the translation defined by a matrix with more columns!!
 		// If the vector is greater, the components that are not affected by the matrix are simply copied. This makes it so that bigger matrices encapsulating smaller transformations can still be used.
-		static_assert(dim < dim_x, "Vector dimension is smaller than matrix number of rows; it is ambiguous if the missing vector components should be extended with 0s or 1s (translation or not)");
+		static_assert(dim >= dim_x, "Vector dimension is smaller than matrix number of rows; it is ambiguous if the missing vector components should be extended with 0s or 1s (translation or not)");
+
+		Vector<T, dim> result(v);
+		if constexpr (simd_matrix && dim == 4)
+		{
+			if (!simd::IsConstantEvaluated())
+			{
+				simd::transform4(&m.data[0][0], &v.data[0], &result.data[0]);
+				return result;
+			}
+		}
+		return transformScalar(m, v);
+	}
+	template <int dim>
+	static constexpr Vector<T, dim> transformScalar(const MatrixBase<T, dim_x, dim_y>& m, const Vector<T, dim>& v)
+	{
+		static_assert(dim >= dim_x, "Vector dimension is smaller than matrix number of rows; it is ambiguous if the missing vector components should be extended with 0s or 1s (translation or not)");
 
 		Vector<T, dim> result(v);
 		for (int i = 0; i < std::min(dim, dim_y); ++i)
 		{
 			// dot product between the matrix row and the vector
-			float dot = 0;
-			Vector<T, dim_x> row = getRow(i);
+			T dot = 0;
 			for (int j = 0; j < dim_x; ++j)
 			{
-				dot += row[j] * v[j];
+				dot += m.data[j][i] * v[j];
 			}
 			result[i] = dot;
 		}
 		return result;
 	}
-	template <int dim>
-	Vector<T, dim> mul(const Vector<T, dim> v)
-	{
-		return mul(this, v);
-	}
-	// Matrix - vector mul operator
-	template <int dim>
-	Vector<T, dim> operator*(const Vector<T, dim>& v)
-	{
-		return mul(this, v);
-	}
-
+public:
 	// Print function
 	void print()
 	{
@@ -227,25 +307,53 @@ public:
 template <typename T, int dim_x, int dim_y>
 class Matrix : public MatrixBase<T, dim_x, dim_y> {
 public:
-	Matrix(const MatrixBase<T, dim_x, dim_y>&& matrix_copy) : MatrixBase<T, dim_x, dim_y>(std::move(matrix_copy)) {}
+	constexpr Matrix() {}
+	constexpr Matrix(const MatrixBase<T, dim_x, dim_y>&& matrix_copy) : MatrixBase<T, dim_x, dim_y>(std::move(matrix_copy)) {}
 };
 template <typename T>
 class Matrix<T, 4, 4> : public MatrixBase<T, 4, 4> {
 public:
-	Matrix(const MatrixBase<T, 4, 4>&& matrix_copy) : MatrixBase<T, 4, 4>(std::move(matrix_copy)) {}
+	constexpr Matrix() {}
+	constexpr Matrix(const MatrixBase<T, 4, 4>&& matrix_copy) : MatrixBase<T, 4, 4>(std::move(matrix_copy)) {}
 
-	// Projection matrix
-	inline friend Matrix<T, 4, 4> initPerspective(T near, T far, T fov, T ar)
+	// Projection matrix, looking down -z and mapping [near, far] to [-1, 1]. fov is the vertical field of view in radians
+	// and ar the aspect ratio (width / height)
+	inline static constexpr Matrix<T, 4, 4> initPerspective(T near, T far, T fov, T ar)
 	{
-		T tanHalfFOV = std::tan(fov/T(2.0));
+		T tanHalfFOV = tangent(fov / T(2.0));
 		T range = far - near;
 		Matrix<T, 4, 4> matrix;
-		matrix.setRow(0, { ar*T(1.0) / tanHalfFOV, 0,                    0,                     0 });
-		matrix.setRow(1, { 0,                      T(1.0) / tanHalfFOV,  0,                     0 });
-		matrix.setRow(2, { 0,                      0,                   -(far - near) / range, -T(2.0)*far*near / range });
-		matrix.setRow(3, { 0,                      0,                   -1,                     0 });
+		matrix.data[0][0] = T(1.0) / (ar * tanHalfFOV);
+		matrix.data[1][1] = T(1.0) / tanHalfFOV;
+		matrix.data[2][2] = -(far + near) / range;
+		matrix.data[2][3] = -1;
+		matrix.data[3][2] = -T(2.0)*far*near / range;
 		return matrix;
 	}
+
+private:
+	// std::tan is not constexpr : Taylor series of sin and cos around 0, after bringing x into [-pi/2, pi/2]
+	static constexpr T tangent(T x)
+	{
+		const double pi = 3.14159265358979323846;
+		double reduced = double(x);
+		while (reduced > pi / 2)
+			reduced -= pi;
+		while (reduced < -pi / 2)
+			reduced += pi;
+
+		double square = reduced * reduced;
+		double sin_term = reduced, cos_term = 1;
+		double sin = sin_term, cos = cos_term;
+		for (int n = 1; n < 12; ++n)
+		{
+			sin_term *= -square / ((2 * n) * (2 * n + 1));
+			cos_term *= -square / ((2 * n - 1) * (2 * n));
+			sin += sin_term;
+			cos += cos_term;
+		}
+		return T(sin / cos);
+	}
 };
 
 // Typedefs some common matrices
@@ -0,0 +1,115 @@
+
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+#include "FastMath.hpp"
+#include "Matrix.hpp"
+#include "Vector.hpp"
+
+// Scale, then rotation, then translation : 8 floats instead of the 16 of a Mat4f, composed and inverted without any 4x4 product.
+// The scale is uniform, which keeps both exact (a non uniform scale followed by a rotation is a shear, that no TRS can hold).
+// Like matrices, a * b is b then a, so a parent transform times a local one gives the world transform.
+class Transform {
+public:
+	// Unit quaternion (x, y, z, w), cross(a, b) being the quaternion product
+	Quat rotation;
+	Vec3 translation;
+	float scale;
+
+	constexpr Transform()
+		: rotation(0.0f, 0.0f, 0.0f, 1.0f), translation(0.0f, 0.0f, 0.0f), scale(1.0f)
+	{
+	}
+	constexpr Transform(const Quat& rotation, const Vec3& translation, float scale = 1.0f)
+		: rotation(rotation), translation(translation), scale(scale)
+	{
+	}
+
+	// Common transform constructors
+	// Rotation of angle radians around axis, which must be normalized
+	template <fast::Accuracy accuracy = fast::Accuracy::Medium>
+	inline static Transform initRotation(const Vec3& axis, float angle)
+	{
+		float s, c;
+		fast::sincos<accuracy>(angle * 0.5f, s, c);
+		return Transform(Quat(axis[0] * s, axis[1] * s, axis[2] * s, c), Vec3(0.0f, 0.0f, 0.0f));
+	}
+	inline static constexpr Transform initTranslation(const Vec3& translation)
+	{
+		return Transform(Quat(0.0f, 0.0f, 0.0f, 1.0f), translation);
+	}
+	inline static constexpr Transform initScale(float scale)
+	{
+		return Transform(Quat(0.0f, 0.0f, 0.0f, 1.0f), Vec3(0.0f, 0.0f, 0.0f), scale);
+	}
+
+	// v rotated by the quaternion : v + w * t + q x t, with t = 2 * (q x v)
+	constexpr Vec3 rotate(const Vec3& v) const
+	{
+		Vec3 q(rotation[0], rotation[1], rotation[2]);
+		Vec3 t = cross(q, v);
+		t = Vec3(t[0] * 2.0f, t[1] * 2.0f, t[2] * 2.0f);
+		Vec3 u = cross(q, t);
+		float w = rotation[3];
+		return Vec3(v[0] + w * t[0] + u[0], v[1] + w * t[1] + u[1], v[2] + w * t[2] + u[2]);
+	}
+	// Points get the whole transform, vectors (directions, offsets) no translation
+	constexpr Vec3 transformPoint(const Vec3& p) const
+	{
+		Vec3 r = transformVector(p);
+		return Vec3(r[0] + translation[0], r[1] + translation[1], r[2] + translation[2]);
+	}
+	constexpr Vec3 transformVector(const Vec3& v) const
+	{
+		return rotate(Vec3(v[0] * scale, v[1] * scale, v[2] * scale));
+	}
+
+	// Composition : (a * b).transformPoint(p) == a.transformPoint(b.transformPoint(p))
+	constexpr Transform operator*(const Transform& b) const
+	{
+		return Transform(cross(rotation, b.rotation), transformPoint(b.translation), scale * b.scale);
+	}
+	constexpr void operator*=(const Transform& b)
+	{
+		*this = *this * b;
+	}
+	// Undoes the transform. The scale must not be 0
+	constexpr Transform inverse() const
+	{
+		Quat conjugate(-rotation[0], -rotation[1], -rotation[2], rotation[3]);
+		float inverse_scale = 1.0f / scale;
+		Transform result(conjugate, Vec3(0.0f, 0.0f, 0.0f), inverse_scale);
+		Vec3 t = result.transformVector(translation);
+		result.translation = Vec3(-t[0], -t[1], -t[2]);
+		return result;
+	}
+	// Long chains of products slowly denormalize the rotation, this brings it back to unit length
+	void normalize()
+	{
+		rotation.normalize();
+	}
+
+	// The same transform as a matrix, for the uniform blocks
+	constexpr Mat4f toMatrix() const
+	{
+		float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+		Mat4f matrix = Mat4f::initIdentity();
+		// data is [column][row]
+		matrix.data[0][0] = scale * (1.0f - 2.0f * (y * y + z * z));
+		matrix.data[0][1] = scale * (2.0f * (x * y + w * z));
+		matrix.data[0][2] = scale * (2.0f * (x * z - w * y));
+		matrix.data[1][0] = scale * (2.0f * (x * y - w * z));
+		matrix.data[1][1] = scale * (1.0f - 2.0f * (x * x + z * z));
+		matrix.data[1][2] = scale * (2.0f * (y * z + w * x));
+		matrix.data[2][0] = scale * (2.0f * (x * z + w * y));
+		matrix.data[2][1] = scale * (2.0f * (y * z - w * x));
+		matrix.data[2][2] = scale * (1.0f - 2.0f * (x * x + y * y));
+		for (int row = 0; row < 3; ++row)
+		{
+			matrix.data[3][row] = translation[row];
+		}
+		return matrix;
+	}
+};
+
+#endif
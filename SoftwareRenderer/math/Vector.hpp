@@ -4,32 +4,47 @@
 
 #include <iostream>
 #include <array>
+#include <type_traits>
 
+#include "simd.hpp"
+#include "VectorExpression.hpp"
+
+// The constructors zero the vector, or copy values into it, through data : that is the member usable in constant expressions,
+// the x, y, z, w names only outside of them
 template <typename T, int dim>
 struct VectorData {
+	constexpr VectorData() : data() {}
+	constexpr VectorData(const std::array<T, dim>& values) : data(values) {}
 	union {
 		std::array<T, dim> data;
 	};
 };
+// 16 byte aligned, so that float vectors load straight into SIMD registers
 template <typename T>
-struct VectorData<T, 4> {
+struct alignas(16) VectorData<T, 4> {
+	constexpr VectorData() : data() {}
+	constexpr VectorData(const std::array<T, 4>& values) : data(values) {}
 	union {
 		std::array<T, 4> data;
-		T x, y, z, w;
+		struct { T x, y, z, w; };
 	};
 };
 template <typename T>
 struct VectorData<T, 3> {
+	constexpr VectorData() : data() {}
+	constexpr VectorData(const std::array<T, 3>& values) : data(values) {}
 	union {
 		std::array<T, 3> data;
-		T x, y, z;
+		struct { T x, y, z; };
 	};
 };
 template <typename T>
 struct VectorData<T, 2> {
+	constexpr VectorData() : data() {}
+	constexpr VectorData(const std::array<T, 2>& values) : data(values) {}
 	union {
 		std::array<T, 2> data;
-		T x, y;
+		struct { T x, y; };
 	};
 };
 // Specialize for zero-length vectors
@@ -37,32 +52,48 @@ template <typename T>
 struct VectorData<T, 0> { };
 
 template <typename T, int dim>
-class VectorBase : public VectorData<T, dim> {
+class VectorBase : public VectorExpression<VectorBase<T, dim>, T, dim>, public VectorData<T, dim> {
 public:
+	// Float 4 vectors go through the SIMD kernels of simd.hpp, except in constant expressions
+	static constexpr bool simd_vector = std::is_same<T, float>::value && dim == 4;
+
 	// ------------------------
 	// Constructors
 	// ------------------------
-	VectorBase() {}
-	VectorBase(std::array<T, dim> _data)
+	constexpr VectorBase() {}
+	constexpr VectorBase(std::array<T, dim> _data)
+		: VectorData<T, dim>(_data)
 	{
-		memcpy(&this->data, &_data, sizeof(T)*dim);
+	}
+	// Computes an expression of VectorExpression.hpp (a + b, a.getNormalized(), ...)
+	template <typename E>
+	constexpr VectorBase(const VectorExpression<E, T, dim>& expression)
+	{
+		evaluate(expression);
+	}
+	template <typename E>
+	constexpr VectorBase<T, dim>& operator=(const VectorExpression<E, T, dim>& expression)
+	{
+		evaluate(expression);
+		return *this;
 	}
 
 	// ------------------------
 	// Length calculations
 	// ------------------------
-	float length() 
+	float length() const
 	{
-		float result = 0;
-		for (int i = 0; i < dim; ++i) 
-		{
-			result += this->data[i] * this->data[i];
-		}
-		return sqrt(result);
+		return sqrt(lengthSquared());
 	}
 
-	float lengthSquared()
+	constexpr float lengthSquared() const
 	{
+		if constexpr (simd_vector)
+		{
+			if (!simd::IsConstantEvaluated())
+				return simd::dot4(this->data.data(), this->data.data());
+		}
+
 		float result = 0;
 		for (int i = 0; i < dim; ++i)
 		{
@@ -74,34 +105,33 @@ public:
 	// ------------------------
 	// Normalization
 	// ------------------------
+	// Divides by the length by default. The Medium and Low tiers multiply by the reciprocal square root of FastMath.hpp instead
+	template <fast::Accuracy accuracy = fast::Accuracy::Full>
 	void normalize()
 	{
-		float len = length();
-		for (int i = 0; i < dim; ++i)
-		{
-			this->data[i] /= len;
-		}
-	}
-	VectorBase<T, dim> getNormalized()
-	{
-		float len = length();
-		VectorBase<T, dim> result;
-		for (int i = 0; i < dim; ++i)
-		{
-			result.data[i] = this->data[i] / len;
-		}
-		return result;
+		evaluate(this->template getNormalized<accuracy>());
 	}
+	// getNormalized, like componentWiseMul and the +, - and / operators, builds an expression (see VectorExpression.hpp)
 
 	// ------------------------
 	// Dot product
 	// ------------------------
-	float dot(const VectorBase<T, dim>& b)
+	constexpr float dot(const VectorBase<T, dim>& b) const
+	{
+		if constexpr (simd_vector)
+		{
+			if (!simd::IsConstantEvaluated())
+				return simd::dot4(this->data.data(), b.data.data());
+		}
+		return constexprDot(*this, b);
+	}
+	// Always the scalar loop, for constant expressions where simd::IsConstantEvaluated can't tell (see constexprMul)
+	inline constexpr friend float constexprDot(const VectorBase<T, dim>& a, const VectorBase<T, dim>& b)
 	{
 		float result = 0;
 		for (int i = 0; i < dim; ++i)
 		{
-			result += this->data[i] * b.data[i];
+			result += a.data[i] * b.data[i];
 		}
 		return result;
 	}
@@ -109,82 +139,46 @@ public:
 	// ------------------------
 	// Component wise multiplication
 	// ------------------------
-	VectorBase<T, dim> componentWiseMul(const VectorBase<T, dim>& b)
-	{
-		VectorBase<T, dim> result;
-		for (int i = 0; i < dim; ++i)
-		{
-			result.data[i] = this->data[i] * b.data[i];
-		}
-		return result;
-	}
-	void componentWiseMulEqual(const VectorBase<T, dim>& b)
+	template <typename E>
+	constexpr void componentWiseMulEqual(const VectorExpression<E, T, dim>& b)
 	{
-		for (int i = 0; i < dim; ++i) 
-		{
-			this->data[i] *= b.data[i];
-		}
+		evaluate(this->componentWiseMul(b));
 	}
 
 	// ------------------------
 	// Operators
 	// ------------------------
-	VectorBase<T, dim> operator+(const VectorBase<T, dim>& b)
+	template <typename E>
+	constexpr void operator+=(const VectorExpression<E, T, dim>& b)
 	{
-		VectorBase<T, dim> result;
-		for (int i = 0; i < dim; ++i) {
-			result.data[i] = this->data[i] + b.data[i];
-		}
-		return result;
-	}
-	VectorBase<T, dim> operator-(const VectorBase<T, dim>& b)
-	{
-		VectorBase<T, dim> result;
-		for (int i = 0; i < dim; ++i) 
-		{
-			result.data[i] = this->data[i] - b.data[i];
-		}
-		return result;
-	}
-	// No multiplication operators since its ambiguous. Call the dot, cross or mul function directly!
-	VectorBase<T, dim> operator/(const VectorBase<T, dim>& b)
-	{
-		VectorBase<T, dim> result;
-		for (int i = 0; i < dim; ++i) {
-			result.data[i] = this->data.data[i] / b.data[i];
-		}
-		return result;
-	}
-	void operator+=(const VectorBase<T, dim>& b)
-	{
-		for (int i = 0; i < dim; ++i) {
-			this->data[i] += b.data[i];
-		}
+		evaluate(*this + b);
 	}
-	void operator-=(const VectorBase<T, dim>& b)
+	template <typename E>
+	constexpr void operator-=(const VectorExpression<E, T, dim>& b)
 	{
-		for (int i = 0; i < dim; ++i)
-		{
-			this->data[i] -= b.data[i];
-		}
+		evaluate(*this - b);
 	}
 	// Again, no multiplication-equal operators since its ambiguous. Call the dot, cross or mul function directly!
-	void operator/=(const VectorBase<T, dim>& b)
+	template <typename E>
+	constexpr void operator/=(const VectorExpression<E, T, dim>& b)
 	{
-		for (int i = 0; i < dim; ++i) {
-			this->data[i] /= b.data[i];
-		}
+		evaluate(*this / b);
 	}
 
 	// Operators for accessing data directly (easier for access in loops)
-	const T operator[](unsigned i) const
+	constexpr const T operator[](unsigned i) const
 	{
 		return this->data[i];
 	}
-	T& operator[](unsigned i)
+	constexpr T& operator[](unsigned i)
 	{
 		return this->data[i];
 	}
+	// The vector as a SIMD register, for evaluating float 4 expressions
+	simd::float4 load() const
+	{
+		return simd::load(this->data.data());
+	}
 	T& at(unsigned i)
 	{
 		// Bound checking
@@ -193,7 +187,7 @@ public:
 	}
 
 	// Check to see if vector is all zeros
-	bool isNull()
+	constexpr bool isNull() const
 	{
 		for (int i = 0; i < dim; ++i) 
 		{
@@ -203,7 +197,7 @@ public:
 		return true;
 	}
 	// Compare two vectors for equality
-	bool isEqual(const VectorBase<T, dim>& b)
+	constexpr bool isEqual(const VectorBase<T, dim>& b) const
 	{
 		for (int i = 0; i < dim; ++i)
 		{
@@ -223,6 +217,26 @@ public:
 		}
 		std::cout << std::endl;
 	}
+
+private:
+	// Every expression is element wise, so the vector can be one of the operands
+	template <typename E>
+	constexpr void evaluate(const VectorExpression<E, T, dim>& expression)
+	{
+		const E& e = expression.self();
+		if constexpr (simd_vector)
+		{
+			if (!simd::IsConstantEvaluated())
+			{
+				simd::store(this->data.data(), e.load());
+				return;
+			}
+		}
+		for (int i = 0; i < dim; ++i)
+		{
+			this->data[i] = e[i];
+		}
+	}
 };
 
 // Specialize VectorBase for zero-length vectors, effectively disabling them to catch possible bugs earlier
@@ -233,31 +247,33 @@ class VectorBase<T, 0> : public VectorData<T, 0> { };
 template <typename T, int dim>
 class Vector {
 public:
-	Vector() {}
+	constexpr Vector() {}
 };
 template <typename T>
 class Vector<T, 4> : public VectorBase<T, 4> {
 public:
-	Vector() {}
-	Vector(VectorBase<T, 4>&& base_copy) : VectorBase<T, 4>(std::move(base_copy)) {}
-	Vector(T x, T y, T z, T w)
-		: VectorBase<T, 4>({ x, y, z, w })
+	constexpr Vector() {}
+	constexpr Vector(VectorBase<T, 4>&& base_copy) : VectorBase<T, 4>(std::move(base_copy)) {}
+	template <typename E>
+	constexpr Vector(const VectorExpression<E, T, 4>& expression) : VectorBase<T, 4>(expression) {}
+	using VectorBase<T, 4>::operator=;
+	constexpr Vector(T x, T y, T z, T w)
+		: VectorBase<T, 4>(std::array<T, 4>{ x, y, z, w })
 	{
 	}
-	Vector(std::array<T, 4>& data)
+	constexpr Vector(std::array<T, 4>& data)
 		: VectorBase<T, 4>(data)
 	{
 	}
 
 	// Quaternion multiplication
-	inline friend Vector<T, 4> cross(const Vector<T, 4>& a, const Vector<T, 4>& b)
+	inline constexpr friend Vector<T, 4> cross(const Vector<T, 4>& a, const Vector<T, 4>& b)
 	{
-		Vector<T, 4> result;
-		result.x = a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y;
-		result.y = a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x;
-		result.z = a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w;
-		result.w = a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z;
-		return result;
+		return Vector<T, 4>(
+			a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1],
+			a[3]*b[1] - a[0]*b[2] + a[1]*b[3] + a[2]*b[0],
+			a[3]*b[2] + a[0]*b[1] - a[1]*b[0] + a[2]*b[3],
+			a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2]);
 	}
 	Vector<T, 4> cross(const Vector<T, 4>& b)
 	{
@@ -267,25 +283,27 @@ public:
 template <typename T>
 class Vector<T, 3> : public VectorBase<T, 3> {
 public:
-	Vector() {}
-	Vector(VectorBase<T, 3>&& base_copy) : VectorBase<T, 3>(std::move(base_copy)) {}
-	Vector(T x, T y, T z)
-		: VectorBase<T, 3>({ x, y, z })
+	constexpr Vector() {}
+	constexpr Vector(VectorBase<T, 3>&& base_copy) : VectorBase<T, 3>(std::move(base_copy)) {}
+	template <typename E>
+	constexpr Vector(const VectorExpression<E, T, 3>& expression) : VectorBase<T, 3>(expression) {}
+	using VectorBase<T, 3>::operator=;
+	constexpr Vector(T x, T y, T z)
+		: VectorBase<T, 3>(std::array<T, 3>{ x, y, z })
 	{
 	}
-	Vector(std::array<T, 3>& data)
+	constexpr Vector(std::array<T, 3>& data)
 		: VectorBase<T, 3>(data)
 	{
 	}
 
 	// Cross product
-	inline friend Vector<T, 3> cross(const Vector<T, 3>& a, const Vector<T, 3>& b)
+	inline constexpr friend Vector<T, 3> cross(const Vector<T, 3>& a, const Vector<T, 3>& b)
 	{
-		Vector<T, 3> result;
-		result.x = a.y * b.z - a.z * b.y;
-		result.y = a.z * b.x - a.x * b.z;
-		result.z = a.x * b.y - a.y * b.x;
-		return result;
+		return Vector<T, 3>(
+			a[1] * b[2] - a[2] * b[1],
+			a[2] * b[0] - a[0] * b[2],
+			a[0] * b[1] - a[1] * b[0]);
 	}
 	Vector<T, 3> cross(const Vector<T, 3>& b)
 	{
@@ -295,21 +313,24 @@ public:
 template <typename T>
 class Vector<T, 2> : public VectorBase<T, 2> {
 public:
-	Vector() {}
-	Vector(VectorBase<T, 2>&& base_copy) : VectorBase<T,2>(std::move(base_copy)) {}
-	Vector(T x, T y)
-		: VectorBase<T, 2>({ x, y })
+	constexpr Vector() {}
+	constexpr Vector(VectorBase<T, 2>&& base_copy) : VectorBase<T,2>(std::move(base_copy)) {}
+	template <typename E>
+	constexpr Vector(const VectorExpression<E, T, 2>& expression) : VectorBase<T, 2>(expression) {}
+	using VectorBase<T, 2>::operator=;
+	constexpr Vector(T x, T y)
+		: VectorBase<T, 2>(std::array<T, 2>{ x, y })
 	{
 	}
-	Vector(std::array<T, 2>& data)
+	constexpr Vector(std::array<T, 2>& data)
 		: VectorBase<T, 2>(data)
 	{
 	}
 
 	// Cross product
-	inline friend float cross(const Vector<T, 2>& a, const Vector<T, 2>& b)
+	inline constexpr friend float cross(const Vector<T, 2>& a, const Vector<T, 2>& b)
 	{
-		return a.x * b.y - a.y * b.x;
+		return a[0] * b[1] - a[1] * b[0];
 	}
 	Vector<T, 2> cross(const Vector<T, 2>& b)
 	{
@@ -337,4 +358,7 @@ typedef Vec4f Quat4;
 typedef Vec3f Vec3;
 typedef Vec2f Vec2;
 
+// The expression base must not add any size, vertex data is read as arrays of vectors
+static_assert(sizeof(Vec3f) == sizeof(float) * 3 && sizeof(Vec4f) == sizeof(float) * 4, "Vectors must be tightly packed");
+
 #endif
\ No newline at end of file
@@ -0,0 +1,177 @@
+
+#ifndef VECTOR_EXPRESSION_HPP
+#define VECTOR_EXPRESSION_HPP
+
+#include <cmath>
+#include <type_traits>
+
+#include "FastMath.hpp"
+#include "simd.hpp"
+
+// Lazy vector arithmetic. a + b, a - b, a / b, componentWiseMul and getNormalized don't compute a vector, they return a small
+// expression object, and the whole expression is computed in a single loop when it is assigned to a vector
+// (for float 4 vectors, as one chain of SIMD registers). So (a + b - c).getNormalized() makes no temporary vectors.
+// Expressions refer to the vectors they were built from : assign them in the same statement, don't keep them in auto variables.
+
+template <typename T, int dim>
+class VectorBase;
+
+// Base of everything that can be an operand, E being the actual expression type (VectorBase itself for vectors).
+// Every E has a constexpr T operator[](unsigned i) const, and a simd::float4 load() const when it is a float 4 expression
+template <typename E, typename T, int dim>
+class VectorExpression {
+public:
+	constexpr const E& self() const
+	{
+		return static_cast<const E&>(*this);
+	}
+
+	constexpr T lengthSquared() const
+	{
+		return dot(*this);
+	}
+	T length() const
+	{
+		return std::sqrt(self().lengthSquared());
+	}
+	template <typename B>
+	constexpr T dot(const VectorExpression<B, T, dim>& b) const
+	{
+		T result = 0;
+		for (int i = 0; i < dim; ++i)
+		{
+			result += self()[i] * b.self()[i];
+		}
+		return result;
+	}
+
+	// Defined below the expression types
+	template <typename B>
+	constexpr auto componentWiseMul(const VectorExpression<B, T, dim>& b) const;
+	template <fast::Accuracy accuracy = fast::Accuracy::Full>
+	auto getNormalized() const;
+};
+
+// Element wise operations, on scalars and on SIMD registers
+struct VectorAdd
+{
+	template <typename T>
+	static constexpr T apply(T a, T b) { return a + b; }
+	static simd::float4 apply4(simd::float4 a, simd::float4 b) { return simd::add(a, b); }
+};
+struct VectorSub
+{
+	template <typename T>
+	static constexpr T apply(T a, T b) { return a - b; }
+	static simd::float4 apply4(simd::float4 a, simd::float4 b) { return simd::sub(a, b); }
+};
+struct VectorMul
+{
+	template <typename T>
+	static constexpr T apply(T a, T b) { return a * b; }
+	static simd::float4 apply4(simd::float4 a, simd::float4 b) { return simd::mul(a, b); }
+};
+struct VectorDiv
+{
+	template <typename T>
+	static constexpr T apply(T a, T b) { return a / b; }
+	static simd::float4 apply4(simd::float4 a, simd::float4 b) { return simd::div(a, b); }
+};
+
+// Vectors are kept by reference, expressions (which are only references themselves) by value, so that the
+// expressions nested in a statement can be returned from the operators
+template <typename E>
+struct ExpressionOperand { typedef const E type; };
+template <typename T, int dim>
+struct ExpressionOperand<VectorBase<T, dim>> { typedef const VectorBase<T, dim>& type; };
+
+template <typename Op, typename A, typename B, typename T, int dim>
+class VectorBinary : public VectorExpression<VectorBinary<Op, A, B, T, dim>, T, dim> {
+public:
+	constexpr VectorBinary(const A& left, const B& right)
+		: left(left), right(right)
+	{
+	}
+
+	constexpr T operator[](unsigned i) const
+	{
+		return Op::apply(left[i], right[i]);
+	}
+	simd::float4 load() const
+	{
+		return Op::apply4(left.load(), right.load());
+	}
+
+private:
+	typename ExpressionOperand<A>::type left;
+	typename ExpressionOperand<B>::type right;
+};
+
+// Every element of a vector with the same scalar
+template <typename Op, typename A, typename T, int dim>
+class VectorScalar : public VectorExpression<VectorScalar<Op, A, T, dim>, T, dim> {
+public:
+	constexpr VectorScalar(const A& vector, T scalar)
+		: vector(vector), scalar(scalar)
+	{
+	}
+
+	constexpr T operator[](unsigned i) const
+	{
+		return Op::apply(vector[i], scalar);
+	}
+	simd::float4 load() const
+	{
+		return Op::apply4(vector.load(), simd::splat(scalar));
+	}
+
+private:
+	typename ExpressionOperand<A>::type vector;
+	T scalar;
+};
+
+template <typename E, typename T, int dim>
+template <typename B>
+constexpr auto VectorExpression<E, T, dim>::componentWiseMul(const VectorExpression<B, T, dim>& b) const
+{
+	return VectorBinary<VectorMul, E, B, T, dim>(self(), b.self());
+}
+template <typename E, typename T, int dim>
+template <fast::Accuracy accuracy>
+auto VectorExpression<E, T, dim>::getNormalized() const
+{
+	// The length of an expression is computed from its values, which are computed again on assignment.
+	// Full does the exact operations of a plain normalization : float 4 vectors times the inverse of their length (one SIMD
+	// multiplication), the others divided by it. On SSE it also beats Medium in MathBenchmark : sqrtss and divss pipeline
+	// better than the dependent Newton step after rsqrtss
+	if constexpr (accuracy == fast::Accuracy::Full || !std::is_same<T, float>::value)
+	{
+		if constexpr (std::is_same<T, float>::value && dim == 4)
+			return VectorScalar<VectorMul, E, T, dim>(self(), 1.0f / self().length());
+		else
+			return VectorScalar<VectorDiv, E, T, dim>(self(), self().length());
+	}
+	else
+	{
+		return VectorScalar<VectorMul, E, T, dim>(self(), fast::rsqrt<accuracy>(self().lengthSquared()));
+	}
+}
+
+// No multiplication operators since its ambiguous. Call the dot, cross or mul function directly!
+template <typename A, typename B, typename T, int dim>
+constexpr VectorBinary<VectorAdd, A, B, T, dim> operator+(const VectorExpression<A, T, dim>& a, const VectorExpression<B, T, dim>& b)
+{
+	return VectorBinary<VectorAdd, A, B, T, dim>(a.self(), b.self());
+}
+template <typename A, typename B, typename T, int dim>
+constexpr VectorBinary<VectorSub, A, B, T, dim> operator-(const VectorExpression<A, T, dim>& a, const VectorExpression<B, T, dim>& b)
+{
+	return VectorBinary<VectorSub, A, B, T, dim>(a.self(), b.self());
+}
+template <typename A, typename B, typename T, int dim>
+constexpr VectorBinary<VectorDiv, A, B, T, dim> operator/(const VectorExpression<A, T, dim>& a, const VectorExpression<B, T, dim>& b)
+{
+	return VectorBinary<VectorDiv, A, B, T, dim>(a.self(), b.self());
+}
+
+#endif
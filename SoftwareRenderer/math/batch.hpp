@@ -0,0 +1,129 @@
+
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstddef>
+
+#include "FastMath.hpp"
+#include "Matrix.hpp"
+#include "simd.hpp"
+
+// Transforms of many vectors at once. Vectors are stored as structure of arrays (one array per component),
+// so the kernels work on 4 vectors per instruction instead of on the 4 components of one.
+// Arrays need no alignment, n does not have to be a multiple of 4, and the outputs may be the inputs
+namespace batch {
+
+// Every kernel sums in the same order as Matrix * Vector, so both give the exact same results on SSE, AArch64 and scalar builds.
+// Not on 32 bit ARM, where vector divisions are approximated (see MATH_SIMD_NEON_DIVIDE)
+
+// out = m * (x, y, z, 1) for n points
+inline void TransformPositions(const Mat4f& m, const float* x, const float* y, const float* z, size_t n, float* out_x, float* out_y, float* out_z, float* out_w)
+{
+	// data is [column][row]
+	const auto& d = m.data;
+	const size_t vector_end = n & ~size_t(3);
+	size_t i = 0;
+	for (; i < vector_end; i += 4)
+	{
+		simd::float4 vx = simd::load(x + i), vy = simd::load(y + i), vz = simd::load(z + i);
+		simd::float4 components[4];
+		for (int row = 0; row < 4; ++row)
+		{
+			simd::float4 result = simd::mul(vx, simd::splat(d[0][row]));
+			result = simd::madd(vy, simd::splat(d[1][row]), result);
+			result = simd::madd(vz, simd::splat(d[2][row]), result);
+			components[row] = simd::add(result, simd::splat(d[3][row]));
+		}
+		simd::store(out_x + i, components[0]);
+		simd::store(out_y + i, components[1]);
+		simd::store(out_z + i, components[2]);
+		simd::store(out_w + i, components[3]);
+	}
+	for (; i < n; ++i)
+	{
+		float px = x[i], py = y[i], pz = z[i];
+		out_x[i] = d[0][0] * px + d[1][0] * py + d[2][0] * pz + d[3][0];
+		out_y[i] = d[0][1] * px + d[1][1] * py + d[2][1] * pz + d[3][1];
+		out_z[i] = d[0][2] * px + d[1][2] * py + d[2][2] * pz + d[3][2];
+		out_w[i] = d[0][3] * px + d[1][3] * py + d[2][3] * pz + d[3][3];
+	}
+}
+
+// out = m * (x, y, z) for n directions, eg. normals with UniformBlock::getNormalMatrix(). Not normalized
+inline void TransformDirections(const Mat3f& m, const float* x, const float* y, const float* z, size_t n, float* out_x, float* out_y, float* out_z)
+{
+	const auto& d = m.data;
+	const size_t vector_end = n & ~size_t(3);
+	size_t i = 0;
+	for (; i < vector_end; i += 4)
+	{
+		simd::float4 vx = simd::load(x + i), vy = simd::load(y + i), vz = simd::load(z + i);
+		simd::float4 components[3];
+		for (int row = 0; row < 3; ++row)
+		{
+			simd::float4 result = simd::mul(vx, simd::splat(d[0][row]));
+			result = simd::madd(vy, simd::splat(d[1][row]), result);
+			components[row] = simd::madd(vz, simd::splat(d[2][row]), result);
+		}
+		simd::store(out_x + i, components[0]);
+		simd::store(out_y + i, components[1]);
+		simd::store(out_z + i, components[2]);
+	}
+	for (; i < n; ++i)
+	{
+		float dx = x[i], dy = y[i], dz = z[i];
+		out_x[i] = d[0][0] * dx + d[1][0] * dy + d[2][0] * dz;
+		out_y[i] = d[0][1] * dx + d[1][1] * dy + d[2][1] * dz;
+		out_z[i] = d[0][2] * dx + d[1][2] * dy + d[2][2] * dz;
+	}
+}
+
+// Accuracy of the reciprocal of w : well under a hundredth of a pixel and of a depth buffer step
+const fast::Accuracy projection_accuracy = fast::Accuracy::Medium;
+
+// Clip space transform, perspective divide and viewport mapping of n points in one pass :
+// screen = ((ndc.x + 1) * width / 2, (ndc.y + 1) * height / 2, ndc.z) with ndc = (m * (x, y, z, 1)).xyz / w.
+// Screen coordinates of points with w <= 0 (behind the camera) are meaningless, check w before using them
+inline void TransformProject(const Mat4f& m, const float* x, const float* y, const float* z, size_t n, float width, float height, float* screen_x, float* screen_y, float* screen_z, float* w)
+{
+	const auto& d = m.data;
+	float half_width = width * 0.5f, half_height = height * 0.5f;
+	simd::float4 vhalf_width = simd::splat(half_width), vhalf_height = simd::splat(half_height);
+	const size_t vector_end = n & ~size_t(3);
+	size_t i = 0;
+	for (; i < vector_end; i += 4)
+	{
+		simd::float4 vx = simd::load(x + i), vy = simd::load(y + i), vz = simd::load(z + i);
+		simd::float4 clip[4];
+		for (int row = 0; row < 4; ++row)
+		{
+			simd::float4 result = simd::mul(vx, simd::splat(d[0][row]));
+			result = simd::madd(vy, simd::splat(d[1][row]), result);
+			result = simd::madd(vz, simd::splat(d[2][row]), result);
+			clip[row] = simd::add(result, simd::splat(d[3][row]));
+		}
+		// (x / w + 1) * half_width = x * (half_width / w) + half_width
+		simd::float4 inv_w = fast::rcp<projection_accuracy>(clip[3]);
+		simd::store(screen_x + i, simd::madd(clip[0], simd::mul(inv_w, vhalf_width), vhalf_width));
+		simd::store(screen_y + i, simd::madd(clip[1], simd::mul(inv_w, vhalf_height), vhalf_height));
+		simd::store(screen_z + i, simd::mul(clip[2], inv_w));
+		simd::store(w + i, clip[3]);
+	}
+	for (; i < n; ++i)
+	{
+		float px = x[i], py = y[i], pz = z[i];
+		float cx = d[0][0] * px + d[1][0] * py + d[2][0] * pz + d[3][0];
+		float cy = d[0][1] * px + d[1][1] * py + d[2][1] * pz + d[3][1];
+		float cz = d[0][2] * px + d[1][2] * py + d[2][2] * pz + d[3][2];
+		float cw = d[0][3] * px + d[1][3] * py + d[2][3] * pz + d[3][3];
+		float inv_w = fast::rcp<projection_accuracy>(cw);
+		screen_x[i] = cx * (inv_w * half_width) + half_width;
+		screen_y[i] = cy * (inv_w * half_height) + half_height;
+		screen_z[i] = cz * inv_w;
+		w[i] = cw;
+	}
+}
+
+}
+
+#endif
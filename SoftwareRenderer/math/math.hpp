@@ -6,5 +6,9 @@
 
 #include "Matrix.hpp"
 #include "Vector.hpp"
+#include "batch.hpp"
+#include "FastMath.hpp"
+#include "Transform.hpp"
+#include "Bounds.hpp"
 
 #endif
\ No newline at end of file
@@ -0,0 +1,275 @@
+
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+// SIMD kernels for 4 wide float vectors and column major 4x4 float matrices, used by Vector and Matrix when T is float.
+// Pointers to vectors and matrices must be 16 byte aligned (Vector<float, 4> and 4 row matrices are).
+
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MATH_SIMD_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define MATH_SIMD_NEON 1
+#include <arm_neon.h>
+// vdivq_f32 is AArch64 only : 32 bit ARM divides with a reciprocal estimate and two Newton steps, which can be off in the last bit
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define MATH_SIMD_NEON_DIVIDE 1
+#endif
+#endif
+
+namespace simd {
+
+// True while a constant expression is being evaluated, where the intrinsics below can't be called : the math types then take their scalar loops.
+// Compilers without the builtin always take the kernels, so the float 4 operators can't be used in constant expressions there.
+// That includes MSVC before 19.25, and so the v141 toolset of the project : constant expressions go through constexprMul
+// (Matrix.hpp) and constexprDot (Vector.hpp) instead, which never reach the kernels.
+constexpr bool IsConstantEvaluated()
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+	return std::is_constant_evaluated();
+#elif defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1925)
+	return __builtin_is_constant_evaluated();
+#else
+	return false;
+#endif
+}
+
+#if defined(MATH_SIMD_SSE)
+
+inline void add4(const float* a, const float* b, float* out)
+{
+	_mm_store_ps(out, _mm_add_ps(_mm_load_ps(a), _mm_load_ps(b)));
+}
+inline void sub4(const float* a, const float* b, float* out)
+{
+	_mm_store_ps(out, _mm_sub_ps(_mm_load_ps(a), _mm_load_ps(b)));
+}
+inline void mul4(const float* a, const float* b, float* out)
+{
+	_mm_store_ps(out, _mm_mul_ps(_mm_load_ps(a), _mm_load_ps(b)));
+}
+inline void div4(const float* a, const float* b, float* out)
+{
+	_mm_store_ps(out, _mm_div_ps(_mm_load_ps(a), _mm_load_ps(b)));
+}
+inline void scale4(const float* a, float s, float* out)
+{
+	_mm_store_ps(out, _mm_mul_ps(_mm_load_ps(a), _mm_set1_ps(s)));
+}
+inline float dot4(const float* a, const float* b)
+{
+	__m128 product = _mm_mul_ps(_mm_load_ps(a), _mm_load_ps(b));
+	// (x + z, y + w, ...) then + the other pair
+	__m128 pairs = _mm_add_ps(product, _mm_movehl_ps(product, product));
+	__m128 sum = _mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1)));
+	return _mm_cvtss_f32(sum);
+}
+
+// out = m * v, m column major : the columns scaled by the components of v, summed
+inline void transform4(const float* m, const float* v, float* out)
+{
+	__m128 vector = _mm_load_ps(v);
+	__m128 result = _mm_mul_ps(_mm_load_ps(m), _mm_shuffle_ps(vector, vector, _MM_SHUFFLE(0, 0, 0, 0)));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_load_ps(m + 4), _mm_shuffle_ps(vector, vector, _MM_SHUFFLE(1, 1, 1, 1))));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_load_ps(m + 8), _mm_shuffle_ps(vector, vector, _MM_SHUFFLE(2, 2, 2, 2))));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_load_ps(m + 12), _mm_shuffle_ps(vector, vector, _MM_SHUFFLE(3, 3, 3, 3))));
+	_mm_store_ps(out, result);
+}
+
+// Row i of a column major matrix
+inline void row4(const float* m, int i, float* out)
+{
+	__m128 c0 = _mm_load_ps(m), c1 = _mm_load_ps(m + 4), c2 = _mm_load_ps(m + 8), c3 = _mm_load_ps(m + 12);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	__m128 rows[4] = { c0, c1, c2, c3 };
+	_mm_store_ps(out, rows[i]);
+}
+
+#elif defined(MATH_SIMD_NEON)
+
+inline void add4(const float* a, const float* b, float* out)
+{
+	vst1q_f32(out, vaddq_f32(vld1q_f32(a), vld1q_f32(b)));
+}
+inline void sub4(const float* a, const float* b, float* out)
+{
+	vst1q_f32(out, vsubq_f32(vld1q_f32(a), vld1q_f32(b)));
+}
+inline void mul4(const float* a, const float* b, float* out)
+{
+	vst1q_f32(out, vmulq_f32(vld1q_f32(a), vld1q_f32(b)));
+}
+inline void div4(const float* a, const float* b, float* out)
+{
+#if defined(MATH_SIMD_NEON_DIVIDE)
+	vst1q_f32(out, vdivq_f32(vld1q_f32(a), vld1q_f32(b)));
+#else
+	float32x4_t divisor = vld1q_f32(b);
+	float32x4_t reciprocal = vrecpeq_f32(divisor);
+	reciprocal = vmulq_f32(vrecpsq_f32(divisor, reciprocal), reciprocal);
+	reciprocal = vmulq_f32(vrecpsq_f32(divisor, reciprocal), reciprocal);
+	vst1q_f32(out, vmulq_f32(vld1q_f32(a), reciprocal));
+#endif
+}
+inline void scale4(const float* a, float s, float* out)
+{
+	vst1q_f32(out, vmulq_n_f32(vld1q_f32(a), s));
+}
+inline float dot4(const float* a, const float* b)
+{
+	float32x4_t product = vmulq_f32(vld1q_f32(a), vld1q_f32(b));
+	float32x2_t pairs = vadd_f32(vget_low_f32(product), vget_high_f32(product));
+	return vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+}
+
+inline void transform4(const float* m, const float* v, float* out)
+{
+	float32x4_t result = vmulq_n_f32(vld1q_f32(m), v[0]);
+	result = vmlaq_n_f32(result, vld1q_f32(m + 4), v[1]);
+	result = vmlaq_n_f32(result, vld1q_f32(m + 8), v[2]);
+	result = vmlaq_n_f32(result, vld1q_f32(m + 12), v[3]);
+	vst1q_f32(out, result);
+}
+
+inline void row4(const float* m, int i, float* out)
+{
+	// De-interleaving load : lane i of every column lands in val[i]
+	float32x4x4_t rows = vld4q_f32(m);
+	vst1q_f32(out, rows.val[i]);
+}
+
+#else
+
+inline void add4(const float* a, const float* b, float* out)
+{
+	for (int i = 0; i < 4; ++i)
+		out[i] = a[i] + b[i];
+}
+inline void sub4(const float* a, const float* b, float* out)
+{
+	for (int i = 0; i < 4; ++i)
+		out[i] = a[i] - b[i];
+}
+inline void mul4(const float* a, const float* b, float* out)
+{
+	for (int i = 0; i < 4; ++i)
+		out[i] = a[i] * b[i];
+}
+inline void div4(const float* a, const float* b, float* out)
+{
+	for (int i = 0; i < 4; ++i)
+		out[i] = a[i] / b[i];
+}
+inline void scale4(const float* a, float s, float* out)
+{
+	for (int i = 0; i < 4; ++i)
+		out[i] = a[i] * s;
+}
+inline float dot4(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+}
+
+inline void transform4(const float* m, const float* v, float* out)
+{
+	float result[4];
+	for (int i = 0; i < 4; ++i)
+		result[i] = m[i] * v[0] + m[4 + i] * v[1] + m[8 + i] * v[2] + m[12 + i] * v[3];
+	for (int i = 0; i < 4; ++i)
+		out[i] = result[i];
+}
+
+inline void row4(const float* m, int i, float* out)
+{
+	for (int c = 0; c < 4; ++c)
+		out[c] = m[c * 4 + i];
+}
+
+#endif
+
+// ------------------------
+// Registers of 4 floats, for kernels working on 4 independent values at once (see batch.hpp).
+// Loads and stores are unaligned
+// ------------------------
+
+#if defined(MATH_SIMD_SSE)
+
+typedef __m128 float4;
+inline float4 load(const float* p) { return _mm_loadu_ps(p); }
+inline void store(float* p, float4 a) { _mm_storeu_ps(p, a); }
+inline float4 splat(float a) { return _mm_set1_ps(a); }
+inline float4 add(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline float4 madd(float4 a, float4 b, float4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline float4 div(float4 a, float4 b) { return _mm_div_ps(a, b); }
+inline float4 minimum(float4 a, float4 b) { return _mm_min_ps(a, b); }
+// Bit i set when lane i is < 0
+inline int negativeMask(float4 a) { return _mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps())); }
+
+#elif defined(MATH_SIMD_NEON)
+
+typedef float32x4_t float4;
+inline float4 load(const float* p) { return vld1q_f32(p); }
+inline void store(float* p, float4 a) { vst1q_f32(p, a); }
+inline float4 splat(float a) { return vdupq_n_f32(a); }
+inline float4 add(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 sub(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 mul(float4 a, float4 b) { return vmulq_f32(a, b); }
+inline float4 madd(float4 a, float4 b, float4 c) { return vmlaq_f32(c, a, b); }
+inline float4 div(float4 a, float4 b)
+{
+#if defined(MATH_SIMD_NEON_DIVIDE)
+	return vdivq_f32(a, b);
+#else
+	float4 reciprocal = vrecpeq_f32(b);
+	reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+	reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+	return vmulq_f32(a, reciprocal);
+#endif
+}
+inline float4 minimum(float4 a, float4 b) { return vminq_f32(a, b); }
+inline int negativeMask(float4 a)
+{
+	uint32x4_t negative = vcltq_f32(a, vdupq_n_f32(0.0f));
+	return (int)((vgetq_lane_u32(negative, 0) & 1) | (vgetq_lane_u32(negative, 1) & 2) | (vgetq_lane_u32(negative, 2) & 4) | (vgetq_lane_u32(negative, 3) & 8));
+}
+
+#else
+
+struct float4 { float v[4]; };
+inline float4 load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+inline void store(float* p, float4 a) { for (int i = 0; i < 4; ++i) p[i] = a.v[i]; }
+inline float4 splat(float a) { return { { a, a, a, a } }; }
+inline float4 add(float4 a, float4 b) { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+inline float4 sub(float4 a, float4 b) { for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+inline float4 mul(float4 a, float4 b) { for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+inline float4 madd(float4 a, float4 b, float4 c) { for (int i = 0; i < 4; ++i) a.v[i] = a.v[i] * b.v[i] + c.v[i]; return a; }
+inline float4 div(float4 a, float4 b) { for (int i = 0; i < 4; ++i) a.v[i] /= b.v[i]; return a; }
+inline float4 minimum(float4 a, float4 b) { for (int i = 0; i < 4; ++i) a.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i]; return a; }
+inline int negativeMask(float4 a)
+{
+	int mask = 0;
+	for (int i = 0; i < 4; ++i) mask |= (a.v[i] < 0.0f) << i;
+	return mask;
+}
+
+#endif
+
+// out = a * b : every column of b transformed by a. out may alias a or b
+inline void multiply4x4(const float* a, const float* b, float* out)
+{
+	alignas(16) float result[16];
+	for (int column = 0; column < 4; ++column)
+	{
+		transform4(a, b + column * 4, result + column * 4);
+	}
+	for (int i = 0; i < 16; ++i)
+		out[i] = result[i];
+}
+
+}
+
+#endif
@@ -1,8 +1,52 @@
+#ifndef RASTERIZER_HPP
+#define RASTERIZER_HPP
 
 #include "math/math.hpp"
 
+#include "Canvas.hpp"
+#include "UniformBlock.hpp"
+
 namespace Rasterizer {
 
+// What the fragment shader gets for each pixel that passed the depth test
+struct FragmentInput
+{
+	int x, y;
+	float z;
+	Vec2 tex_coord; // Interpolated with perspective correction
+	Vec4 color; // Of the triangle, flat
+};
+
+// Fragment shader : called for each pixel of a triangle, writes its RGBA color in [0,1]
+typedef void(*FragmentShader)(const FragmentInput& input, const UniformBlock& uniforms, Vec4& color);
+
+// A value interpolated linearly over the screen : origin + x * dx + y * dy
+struct Gradient
+{
+	float origin, dx, dy;
+};
+
+// What the shaded raster functions need besides the vertices, set up once per triangle.
+// Texture coordinates divided by w interpolate linearly on screen, and so does 1 / w, which brings them back
+struct Shading
+{
+	FragmentShader shader;
+	const UniformBlock* uniforms;
+	Gradient u_over_w, v_over_w, inv_w;
+};
+
+// Rasterizes one triangle of a given type with a fixed combination of states
+// The color is RGBA in [0,1], flat over the triangle. Shaded functions pass it to the fragment shader, the others draw it,
+// and ignore shading (which may be nullptr)
+typedef void(*RasterFunction)(float ax, float ay, float az, float bx, float by, float bz, float cx, float cy, float cz, const Vec4& color, const Shading* shading);
+
 void RasterizeTriangle(float ax, float ay, float az, float bx, float by, float bz, float cx, float cy, float cz, bool first_type);
 
-}
\ No newline at end of file
+// Returns the raster function specialized for this combination of states.
+// Meant to be looked up once (see RenderPass::CreatePipelineState), so that nothing is tested per pixel.
+// Shaded functions run the fragment shader of their Shading for every pixel that passes the depth test.
+RasterFunction GetRasterFunction(bool first_type, bool depth_test, bool depth_write, BlendMode blend_mode, bool shaded = false);
+
+}
+
+#endif